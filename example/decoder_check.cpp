@@ -0,0 +1,41 @@
+#include "babylon.h"
+#include <iostream>
+
+// Decodes a few phrases with a split model both window by window, the way it is streamed, and as
+// one whole latent, and fails when the two differ by more than the tolerance relative to the peak.
+// Run it after choosing --decoder-window and --decoder-overlap in piper_to_babylon.py.
+
+static const std::vector<std::string> TEXTS = {
+    "Hi.",
+    "The quick brown fox jumps over the lazy dog.",
+    "How much wood would a woodchuck chuck if a woodchuck could chuck wood? Nobody knows, but it is a lot of wood.",
+    "In 1969 two astronauts walked on the moon while millions watched. Mr. Armstrong went first; Mr. Aldrin followed.",
+};
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: decoder_check <g2p model> <split tts model> [tolerance]" << std::endl;
+        return 1;
+    }
+
+    float tolerance = argc > 3 ? std::stof(argv[3]) : 0.01f;
+
+    DeepPhonemizer::Session dp(argv[1]);
+    Vits::Session vits(argv[2]);
+
+    if (!vits.is_split()) {
+        std::cerr << argv[2] << " is not a split model." << std::endl;
+        return 1;
+    }
+
+    int failures = 0;
+    for (const auto& text : TEXTS) {
+        float error = vits.decoder_error(dp.g2p(text));
+        bool passed = error <= tolerance;
+        failures += passed ? 0 : 1;
+
+        std::cout << (passed ? "ok    " : "FAIL  ") << error << "  " << text << std::endl;
+    }
+
+    return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+#include "babylon.h"
+#include <iomanip>
+#include <iostream>
+
+// Measures the low memory profile: lazily loaded sessions, their resident memory per component,
+// and how long the first request takes once the models were released (cold re-activation)
+// compared to a request against loaded models.
+
+static const std::string TEXT = "The quick brown fox jumps over the lazy dog. How much wood would a woodchuck chuck?";
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double megabytes(size_t bytes) {
+    return bytes / (1024.0 * 1024.0);
+}
+
+static double synthesize(DeepPhonemizer::Session& dp, Vits::Session& vits) {
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::vector<std::string>> phonemes;
+    std::vector<float> pauses;
+    for (const auto& segment : DeepPhonemizer::segment_text(TEXT)) {
+        phonemes.push_back(dp.g2p(segment.text));
+        pauses.push_back(segment.pause);
+    }
+
+    Babylon::AudioWriter writer([](const char*, size_t) {}, vits.get_sample_rate(), Babylon::AudioFormat::FLOAT32, Babylon::AudioContainer::RAW);
+    vits.tts(phonemes, pauses, writer);
+    writer.close();
+
+    return milliseconds_since(start);
+}
+
+static void report(const std::string& label, DeepPhonemizer::Session& dp, Vits::Session& vits) {
+    std::cout << std::left << std::setw(22) << label << std::right << std::fixed << std::setprecision(1)
+              << "process " << std::setw(7) << megabytes(Babylon::resident_bytes()) << " MB"
+              << "  g2p model " << std::setw(6) << megabytes(dp.get_model_bytes()) << " MB"
+              << "  dictionaries " << std::setw(5) << megabytes(dp.get_dictionary_bytes()) << " MB"
+              << "  tts model " << std::setw(6) << megabytes(vits.get_model_bytes()) << " MB"
+              << "  tts cache " << std::setw(5) << megabytes(vits.get_cache_bytes()) << " MB" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: low_memory <g2p model> <tts model> [rounds]" << std::endl;
+        return 1;
+    }
+
+    int rounds = argc > 3 ? std::stoi(argv[3]) : 5;
+    size_t baseline = Babylon::resident_bytes();
+
+    Babylon::ModelOptions options;
+    options.lazy_load = true;
+
+    auto start = std::chrono::steady_clock::now();
+    DeepPhonemizer::Session dp(argv[1], "en_us", true, false, options);
+    Vits::Session vits(argv[2], options);
+    double init = milliseconds_since(start);
+
+    size_t resident = Babylon::resident_bytes();
+    std::cout << "lazy init " << std::fixed << std::setprecision(1) << init << " ms, "
+              << megabytes(resident > baseline ? resident - baseline : 0) << " MB above baseline" << std::endl;
+
+    report("after init", dp, vits);
+
+    double first = synthesize(dp, vits);
+    report("after first request", dp, vits);
+
+    double warm = 0.0;
+    double cold = 0.0;
+    for (int i = 0; i < rounds; i++) {
+        warm += synthesize(dp, vits);
+
+        dp.unload();
+        vits.unload();
+        if (i == 0) {
+            report("after unload", dp, vits);
+        }
+
+        cold += synthesize(dp, vits);
+    }
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "first request  " << std::setw(8) << first << " ms" << std::endl
+              << "warm request   " << std::setw(8) << warm / rounds << " ms" << std::endl
+              << "cold request   " << std::setw(8) << cold / rounds << " ms (models reloaded)" << std::endl
+              << "re-activation  " << std::setw(8) << (cold - warm) / rounds << " ms" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+#include "babylon.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Forks workers that each load the same VITS model, once with private weights and once
+// with shared (mmap'd) weights, and reports how much memory each additional worker costs.
+
+struct Usage {
+    long rss_kb = 0;
+    long pss_kb = 0;
+    long private_kb = 0;
+};
+
+struct WorkerResult {
+    Usage before;
+    Usage loaded;
+    Usage all_loaded;
+    int failed;
+};
+
+static Usage read_usage() {
+    Usage usage;
+    std::ifstream smaps("/proc/self/smaps_rollup");
+    std::string line;
+
+    while (std::getline(smaps, line)) {
+        std::istringstream fields(line);
+        std::string key;
+        long value;
+        fields >> key >> value;
+
+        if (key == "Rss:") {
+            usage.rss_kb = value;
+        }
+        else if (key == "Pss:") {
+            usage.pss_kb = value;
+        }
+        else if (key == "Private_Clean:" || key == "Private_Dirty:") {
+            usage.private_kb += value;
+        }
+    }
+
+    return usage;
+}
+
+// Loops over short reads and writes, false on error or when the other end closed
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void* data, size_t size) {
+    char* bytes = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t count = read(fd, bytes, size);
+        if (count <= 0) {
+            return false;
+        }
+        bytes += count;
+        size -= count;
+    }
+    return true;
+}
+
+// Returns the PSS delta per worker in KiB, or -1 if a worker failed
+static long run_workers(const std::string& model_path, int workers, bool shared_weights) {
+    int ready[2], release[2], results[2];
+    if (pipe(ready) != 0 || pipe(release) != 0 || pipe(results) != 0) {
+        throw std::runtime_error("Failed to create pipes.");
+    }
+
+    int started = 0;
+    for (int i = 0; i < workers; i++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            std::cerr << "Failed to fork worker: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (pid == 0) {
+            close(ready[0]);
+            close(release[1]);
+            close(results[0]);
+
+            WorkerResult result = {};
+            result.before = read_usage();
+
+            try {
+                Babylon::ModelOptions options;
+                options.shared_weights = shared_weights;
+
+                Vits::Session vits(model_path, options);
+                result.loaded = read_usage();
+
+                // Hold the session until every worker has loaded so PSS splits the shared pages,
+                // closing ready lets the parent see EOF instead of waiting on a worker that died
+                char byte = 1;
+                bool signalled = write_all(ready[1], &byte, 1);
+                close(ready[1]);
+
+                // The parent closes release once every worker is ready, the read returns at EOF
+                if (!signalled || read(release[0], &byte, 1) < 0) {
+                    result.failed = 1;
+                }
+
+                result.all_loaded = read_usage();
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                result.failed = 1;
+
+                char byte = 1;
+                write_all(ready[1], &byte, 1);
+                close(ready[1]);
+            }
+
+            _exit(write_all(results[1], &result, sizeof(result)) ? 0 : 1);
+        }
+
+        started++;
+    }
+
+    // Only the workers may hold the write ends, otherwise a crashed worker would block these reads forever
+    close(ready[1]);
+    close(release[0]);
+    close(results[1]);
+
+    for (int i = 0; i < started; i++) {
+        char byte;
+        if (!read_all(ready[0], &byte, 1)) {
+            break;
+        }
+    }
+    close(release[1]);
+
+    long private_delta = 0, pss_delta = 0, rss_delta = 0;
+    int failed = workers - started;
+    for (int i = 0; i < started; i++) {
+        WorkerResult result;
+        if (!read_all(results[0], &result, sizeof(result))) {
+            failed += started - i;
+            break;
+        }
+
+        failed += result.failed;
+        private_delta += result.loaded.private_kb - result.before.private_kb;
+        rss_delta += result.loaded.rss_kb - result.before.rss_kb;
+        pss_delta += result.all_loaded.pss_kb - result.before.pss_kb;
+    }
+
+    while (wait(nullptr) > 0) {}
+
+    close(ready[0]);
+    close(results[0]);
+
+    if (failed > 0) {
+        std::cout << (shared_weights ? "shared " : "private") << "  " << failed << " worker(s) failed to load the model" << std::endl;
+        return -1;
+    }
+
+    std::cout << (shared_weights ? "shared " : "private")
+              << "  RSS delta " << rss_delta / workers / 1024 << " MiB"
+              << "  private delta " << private_delta / workers / 1024 << " MiB"
+              << "  PSS delta " << pss_delta / workers / 1024 << " MiB (per worker)" << std::endl;
+
+    return pss_delta / workers;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "Usage: shared_weights <model.ort> [workers] [max shared PSS MiB per worker]" << std::endl;
+        return 1;
+    }
+
+    std::string model_path = argv[1];
+    int workers = argc > 2 ? std::stoi(argv[2]) : 4;
+
+    std::cout << workers << " workers loading " << model_path << std::endl;
+
+    long private_pss = run_workers(model_path, workers, false);
+    long shared_pss = run_workers(model_path, workers, true);
+    if (private_pss < 0 || shared_pss < 0) {
+        return 1;
+    }
+
+    // Shared weights are only counted 1/workers per process, by default allow up to half of a private copy
+    long bound_kb = argc > 3 ? std::stol(argv[3]) * 1024 : private_pss / 2;
+    if (shared_pss > bound_kb) {
+        std::cerr << "Shared PSS delta " << shared_pss / 1024 << " MiB per worker exceeds the bound of " << bound_kb / 1024 << " MiB" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
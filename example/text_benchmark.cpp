@@ -0,0 +1,196 @@
+#include "babylon.h"
+#include "text_checks.h"
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <unordered_map>
+
+// Times the text front end, which needs no model: cleaners, segmentation and both sequence
+// tokenizers, reported in ns/op next to the original cleaners. --check first runs random and real
+// inputs through them, compares the cleaners with the reference and verifies the invariants that
+// optimized versions must keep; build with -fsanitize=address,undefined to also catch memory errors.
+// --output writes the timings, --baseline fails when one is slower than a saved run by more than
+// --tolerance. Pass text files to add them to the corpus.
+
+static const std::vector<std::string> CORPUS = {
+    "The quick brown fox jumps over the lazy dog.",
+    "Dr. Smith paid 1250 dollars for 3 tickets on Friday, then went home.",
+    "How much wood would a woodchuck chuck if a woodchuck could chuck wood? Nobody knows.",
+    "In 1969 two astronauts walked on the moon while millions watched. Mr. Armstrong went first; Mr. Aldrin followed.",
+    "Pi is 3.14159, e is 2.71828 and 1,000,000,000,000,000,000,000 is a very large number!",
+    "St. Louis, Mt. Everest and Ft. Worth: J. R. R. Tolkien wrote about none of them...",
+};
+
+static int failures = 0;
+
+static void fail(const std::string& what, const std::string& input) {
+    if (failures++ < 10) {
+        std::cerr << "FAIL " << what << " for input \"" << input << "\"" << std::endl;
+    }
+}
+
+struct Result {
+    std::string name;
+    double ns_per_op;
+};
+
+template <typename Function>
+static void bench(std::vector<Result>& results, const std::string& name, size_t iterations, Function function) {
+    function();
+
+    // Best of a few rounds, so a baseline comparison is not thrown off by a noisy neighbour
+    double ns_per_op = 0.0;
+    for (int round = 0; round < 3; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++) {
+            function();
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        ns_per_op = round == 0 ? elapsed / iterations : std::min(ns_per_op, elapsed / iterations);
+    }
+
+    results.push_back({name, ns_per_op});
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed << std::setprecision(1)
+              << std::setw(12) << ns_per_op << " ns/op" << std::endl;
+}
+
+// One "name<TAB>ns/op" line per benchmark, lines starting with # are comments
+static void write_results(const std::string& path, const std::vector<Result>& results) {
+    std::ofstream file(path);
+    file << "# text_benchmark ns/op" << std::endl;
+    for (const auto& result : results) {
+        file << result.name << "\t" << std::fixed << std::setprecision(1) << result.ns_per_op << std::endl;
+    }
+    if (!file) {
+        throw std::runtime_error("Failed to write " + path);
+    }
+}
+
+// Counts the benchmarks slower than the baseline by more than the tolerance, a fraction of the baseline
+static int compare_results(const std::string& path, const std::vector<Result>& results, double tolerance) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Failed to open baseline " + path);
+    }
+
+    std::unordered_map<std::string, double> baseline;
+    for (std::string line; std::getline(file, line);) {
+        size_t tab = line.find('\t');
+        if (line.empty() || line[0] == '#' || tab == std::string::npos) {
+            continue;
+        }
+        baseline[line.substr(0, tab)] = std::stod(line.substr(tab + 1));
+    }
+
+    int regressions = 0;
+    for (const auto& result : results) {
+        auto expected = baseline.find(result.name);
+        if (expected == baseline.end()) {
+            std::cout << "no baseline for " << result.name << std::endl;
+            continue;
+        }
+
+        if (result.ns_per_op > expected->second * (1.0 + tolerance)) {
+            std::cerr << "REGRESSION " << result.name << ": " << result.ns_per_op << " ns/op, baseline " << expected->second << " ns/op" << std::endl;
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> corpus = CORPUS;
+    size_t check_iterations = 0;
+    size_t iterations = 20000;
+    std::string output_path;
+    std::string baseline_path;
+    double tolerance = 0.5;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--check" && i + 1 < argc) {
+            check_iterations = std::stoul(argv[++i]);
+        }
+        else if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::stoul(argv[++i]);
+        }
+        else if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+        }
+        else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        }
+        else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::stod(argv[++i]);
+        }
+        else {
+            std::ifstream file(arg);
+            if (!file) {
+                std::cerr << "Usage: text_benchmark [--check <random inputs>] [--iterations <n>] [--output <results.tsv>] [--baseline <results.tsv>] [--tolerance <fraction>] [corpus.txt ...]" << std::endl;
+                return 1;
+            }
+            for (std::string line; std::getline(file, line);) {
+                corpus.push_back(line);
+            }
+        }
+    }
+
+    TextChecks::Tokenizers tokenizers;
+
+    if (check_iterations > 0) {
+        std::mt19937 rng(0);
+        for (const auto& text : corpus) {
+            for (const auto& language : TextChecks::languages()) {
+                TextChecks::check_text(text, language, tokenizers, fail);
+            }
+        }
+        for (size_t i = 0; i < check_iterations; i++) {
+            const auto& languages = TextChecks::languages();
+            TextChecks::check_text(TextChecks::random_text(rng), languages[i % languages.size()], tokenizers, fail);
+            TextChecks::check_number(TextChecks::random_digits(rng), fail);
+            TextChecks::check_tokens(TextChecks::random_tokens(rng), tokenizers, fail);
+        }
+
+        std::cout << check_iterations << " random inputs and " << corpus.size() << " corpus lines checked, " << failures << " failures" << std::endl;
+        if (failures > 0) {
+            return 1;
+        }
+    }
+
+    if (iterations == 0) {
+        return 0;
+    }
+
+    std::string text;
+    for (const auto& line : corpus) {
+        text += line + " ";
+    }
+
+    std::vector<std::string_view> views;
+    std::vector<int64_t> text_ids = tokenizers.text("woodchuck", "en_us");
+    std::vector<int64_t> phoneme_sequence = {1, 10, 0, 25, 0, 17, 0, 30, 0, 2};
+    std::vector<std::string> phonemes = {"h", "ə", "l", "ˈ", "o", "ʊ", " ", "w", "ɛ", "l", "d"};
+    std::vector<Result> results;
+
+    bench(results, "clean_text (views, corpus)", iterations / 10, [&] { views.clear(); DeepPhonemizer::clean_text(text, "en_us", views); });
+    bench(results, "clean_text (strings, corpus)", iterations / 10, [&] { DeepPhonemizer::clean_text(text, "en_us"); });
+    bench(results, "clean_text (reference, corpus)", iterations / 10, [&] { Reference::clean_text(text); });
+    bench(results, "clean_text (number)", iterations, [&] { views.clear(); DeepPhonemizer::clean_text("1234567890123", "en_us", views); });
+    bench(results, "clean_text (reference number)", iterations, [&] { Reference::clean_text("1234567890123"); });
+    bench(results, "segment_text (corpus)", iterations / 10, [&] { DeepPhonemizer::segment_text(text, "en_us"); });
+    bench(results, "DeepPhonemizer::SequenceTokenizer", iterations, [&] { tokenizers.text("woodchuck", "en_us"); });
+    bench(results, "DeepPhonemizer decode", iterations, [&] { tokenizers.text.decode(text_ids); });
+    bench(results, "DeepPhonemizer clean", iterations, [&] { tokenizers.phoneme.clean(phoneme_sequence); });
+    bench(results, "Vits::SequenceTokenizer", iterations, [&] { tokenizers.vits(phonemes); });
+
+    if (!output_path.empty()) {
+        write_results(output_path, results);
+    }
+
+    if (!baseline_path.empty() && compare_results(baseline_path, results, tolerance) > 0) {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,186 @@
+#ifndef BABYLON_TEXT_CHECKS_H
+#define BABYLON_TEXT_CHECKS_H
+
+#include "babylon.h"
+#include "reference_cleaners.h"
+#include <algorithm>
+#include <cctype>
+#include <functional>
+#include <random>
+
+// Invariants of the text front end shared by text_benchmark --check and the text_fuzzer target.
+// Every violation is passed to fail with a description and the input that caused it.
+namespace TextChecks {
+  using Failure = std::function<void(const std::string& what, const std::string& input)>;
+
+  inline const std::vector<std::string>& languages() {
+    static const std::vector<std::string> languages = {"en_us", "de"};
+    return languages;
+  }
+
+  inline const std::vector<std::string>& phonemes() {
+    static const std::vector<std::string> phonemes = {"_", "^", "$", " ", "a", "b", "d", "e", "f", "h", "i", "j", "k", "l", "m", "n", "o", "p", "s", "t", "u", "v", "w", "z", "æ", "ð", "ŋ", "ɑ", "ɔ", "ə", "ɛ", "ɪ", "ʃ", "ʊ", "ʌ", "ˈ"};
+    return phonemes;
+  }
+
+  // The three tokenizers a model would carry, built from fixed symbol sets so no model is needed
+  struct Tokenizers {
+    DeepPhonemizer::SequenceTokenizer text;
+    DeepPhonemizer::SequenceTokenizer phoneme;
+    Vits::SequenceTokenizer vits;
+
+    Tokenizers() : text(text_symbols(), languages(), 3, true), phoneme(phonemes(), languages(), 1, false), vits(phonemes(), phoneme_ids()) {}
+
+    // Vits IDs are offset from the positions so a tokenizer that returns positions is caught
+    static int64_t vits_id(size_t index) {
+      return static_cast<int64_t>(index) + 3;
+    }
+
+    private:
+      static std::vector<std::string> text_symbols() {
+        std::vector<std::string> symbols;
+        for (char c = 'a'; c <= 'z'; c++) {
+          symbols.push_back(std::string(1, c));
+        }
+        for (const char* symbol : {"ä", "ö", "ü", "ß", "'", "-"}) {
+          symbols.push_back(symbol);
+        }
+        return symbols;
+      }
+
+      static std::vector<int> phoneme_ids() {
+        std::vector<int> ids;
+        for (size_t i = 0; i < phonemes().size(); i++) {
+          ids.push_back(static_cast<int>(vits_id(i)));
+        }
+        return ids;
+      }
+  };
+
+  inline bool is_space(char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+  }
+
+  inline std::string join(const std::vector<std::string>& words) {
+    std::string joined;
+    for (const auto& word : words) {
+      joined += "[" + word + "]";
+    }
+    return joined;
+  }
+
+  // Cleaners and segmentation on arbitrary text
+  inline void check_text(const std::string& text, const std::string& language, const Tokenizers& tokenizers, const Failure& fail) {
+    // The allocating overload must agree with the view based one it wraps
+    std::vector<std::string_view> views;
+    DeepPhonemizer::clean_text(text, language, views);
+    std::vector<std::string> words = DeepPhonemizer::clean_text(text, language);
+    if (!std::equal(words.begin(), words.end(), views.begin(), views.end())) {
+      fail("clean_text overloads differ", text);
+    }
+
+    // Every language falls back to the English tables, which must still read like the original cleaners
+    std::vector<std::string> expected = Reference::clean_text(text);
+    if (words != expected) {
+      fail("clean_text differs from the reference: " + join(words) + " instead of " + join(expected), text);
+    }
+
+    for (const auto& word : words) {
+      if (word.empty() || std::any_of(word.begin(), word.end(), is_space)) {
+        fail("clean_text word with whitespace", text);
+      }
+    }
+
+    // Segments keep every non whitespace character in order
+    std::string joined;
+    for (const auto& segment : DeepPhonemizer::segment_text(text, language)) {
+      if (segment.pause < 0.0f) {
+        fail("negative pause", text);
+      }
+      joined += segment.text;
+    }
+    std::string compact = text;
+    compact.erase(std::remove_if(compact.begin(), compact.end(), is_space), compact.end());
+    joined.erase(std::remove_if(joined.begin(), joined.end(), is_space), joined.end());
+    if (joined != compact) {
+      fail("segment_text lost text", text);
+    }
+
+    for (const auto& word : words) {
+      if (tokenizers.text(word, language).size() != 50) {
+        fail("tokenizer output not padded to 50", word);
+      }
+    }
+  }
+
+  // Digit strings of any length, where the number expander branches the most
+  inline void check_number(const std::string& digits, const Failure& fail) {
+    std::vector<std::string> words = DeepPhonemizer::clean_text(digits, "en_us");
+    std::vector<std::string> expected = Reference::numbers_to_words(digits);
+    if (words != expected) {
+      fail("numbers_to_words differs from the reference: " + join(words) + " instead of " + join(expected), digits);
+    }
+  }
+
+  // Any model output, including IDs outside the vocabulary, must decode. Vits sequences are laid
+  // out as ^ _ p _ p _ ... $ with unknown phonemes dropped.
+  inline void check_tokens(const std::vector<int64_t>& sequence, const Tokenizers& tokenizers, const Failure& fail) {
+    tokenizers.phoneme.decode(sequence);
+    std::vector<std::string> decoded = tokenizers.phoneme.decode(tokenizers.phoneme.clean(sequence));
+
+    std::vector<int64_t> expected = {1, 0};
+    for (const auto& phoneme : decoded) {
+      auto known = std::find(phonemes().begin(), phonemes().end(), phoneme);
+      if (known != phonemes().end()) {
+        expected.push_back(Tokenizers::vits_id(known - phonemes().begin()));
+        expected.push_back(0);
+      }
+    }
+    expected.push_back(2);
+
+    if (tokenizers.vits(decoded) != expected) {
+      fail("Vits::SequenceTokenizer layout", join(decoded));
+    }
+  }
+
+  // Printable ASCII with extra digits, punctuation and whitespace, where the cleaners branch the most
+  inline std::string random_text(std::mt19937& rng) {
+    static const std::string alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789000.,;:!?'\"()-  \n\t";
+    std::uniform_int_distribution<size_t> length(0, 200);
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<int> byte(0, 255);
+
+    std::string text(length(rng), ' ');
+    for (char& c : text) {
+      // Mostly the alphabet, sometimes any byte so invalid UTF-8 is covered too
+      c = byte(rng) < 8 ? static_cast<char>(byte(rng)) : alphabet[pick(rng)];
+    }
+    return text;
+  }
+
+  inline std::string random_digits(std::mt19937& rng) {
+    std::uniform_int_distribution<size_t> length(1, 45);
+    std::uniform_int_distribution<int> digit(0, 13);
+
+    std::string digits(length(rng), '0');
+    for (char& c : digits) {
+      // Zero heavy so empty groups and scales come up often
+      int d = digit(rng);
+      c = d > 9 ? '0' : static_cast<char>('0' + d);
+    }
+    return digits;
+  }
+
+  inline std::vector<int64_t> random_tokens(std::mt19937& rng) {
+    std::uniform_int_distribution<int64_t> id(-4, static_cast<int64_t>(phonemes().size()) + 8);
+    std::uniform_int_distribution<size_t> length(0, 60);
+
+    std::vector<int64_t> sequence(length(rng));
+    for (auto& token : sequence) {
+      token = id(rng);
+    }
+    return sequence;
+  }
+}
+
+#endif // BABYLON_TEXT_CHECKS_H
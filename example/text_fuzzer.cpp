@@ -0,0 +1,42 @@
+#include "text_checks.h"
+#include <cstdlib>
+#include <iostream>
+
+// libFuzzer entry point for the text front end, built with -DBUILD_FUZZERS=ON. The input is used
+// as text, its digits as a number and its bytes as model output IDs, every check of
+// text_benchmark --check applies and a violation aborts so libFuzzer keeps the input.
+//   build/example/text_fuzzer -max_len=512 corpus/
+
+static void fail(const std::string& what, const std::string& input) {
+    std::cerr << "FAIL " << what << " for input \"" << input << "\"" << std::endl;
+    std::abort();
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    static const TextChecks::Tokenizers tokenizers;
+
+    std::string text(reinterpret_cast<const char*>(data), size);
+    const auto& languages = TextChecks::languages();
+    const std::string& language = languages[size > 0 ? data[0] % languages.size() : 0];
+
+    TextChecks::check_text(text, language, tokenizers, fail);
+
+    std::string digits;
+    for (char c : text) {
+        if (std::isdigit(static_cast<unsigned char>(c))) {
+            digits.push_back(c);
+        }
+    }
+    if (!digits.empty()) {
+        TextChecks::check_number(digits, fail);
+    }
+
+    // Centered on the vocabulary so both valid and out of range IDs come up
+    std::vector<int64_t> sequence;
+    for (size_t i = 0; i < size; i++) {
+        sequence.push_back(static_cast<int64_t>(static_cast<int8_t>(data[i])));
+    }
+    TextChecks::check_tokens(sequence, tokenizers, fail);
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "babylon.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Runs the same concurrent TTS load under each threading mode, every mode in a fresh process
+// since the ORT thread pool can only be configured once. Restrict the cores with taskset to
+// compare machine sizes, e.g. taskset -c 0-3 threading_modes g2p.onnx vits.onnx
+
+struct Configuration {
+    const char* name;
+    Babylon::ThreadingMode mode;
+    bool pin_threads;
+};
+
+struct Result {
+    int failed;
+    double requests_per_second;
+    double audio_per_second;
+    double p50;
+    double p95;
+};
+
+static const std::vector<std::string> TEXTS = {
+    "The quick brown fox jumps over the lazy dog.",
+    "Dr. Smith paid 1250 dollars for 3 tickets on Friday, then went home.",
+    "How much wood would a woodchuck chuck if a woodchuck could chuck wood? Nobody knows.",
+    "In 1969 two astronauts walked on the moon while millions watched.",
+};
+
+static double percentile(std::vector<double> values, double p) {
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p / 100.0 * values.size()))];
+}
+
+static Result run(const Configuration& configuration, const std::string& g2p_model, const std::string& tts_model, size_t requests, size_t concurrency) {
+    Babylon::ThreadingOptions options;
+    options.mode = configuration.mode;
+    options.pin_threads = configuration.pin_threads;
+    Babylon::configure_threading(options);
+
+    DeepPhonemizer::Session dp(g2p_model);
+    Vits::Session vits(tts_model);
+
+    auto synthesize = [&](const std::string& text) {
+        std::vector<std::vector<std::string>> phonemes;
+        std::vector<float> pauses;
+        for (const auto& segment : DeepPhonemizer::segment_text(text)) {
+            phonemes.push_back(dp.g2p(segment.text));
+            pauses.push_back(segment.pause);
+        }
+
+        Babylon::AudioWriter writer([](const char*, size_t) {}, vits.get_sample_rate(), Babylon::AudioFormat::FLOAT32, Babylon::AudioContainer::RAW);
+        vits.tts(phonemes, pauses, writer);
+        writer.close();
+        return static_cast<double>(writer.samples_written()) / vits.get_sample_rate();
+    };
+
+    synthesize(TEXTS[0]);
+
+    std::vector<double> latencies(requests);
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    double audio_seconds = 0.0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < concurrency; c++) {
+        clients.emplace_back([&, c] {
+            if (Babylon::pin_request_threads()) {
+                Babylon::pin_thread(c);
+            }
+
+            for (size_t i = next++; i < requests; i = next++) {
+                auto request_start = std::chrono::steady_clock::now();
+                double seconds = synthesize(TEXTS[i % TEXTS.size()]);
+                latencies[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - request_start).count();
+
+                std::lock_guard<std::mutex> lock(mutex);
+                audio_seconds += seconds;
+            }
+        });
+    }
+
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return {0, requests / elapsed, audio_seconds / elapsed, percentile(latencies, 50), percentile(latencies, 95)};
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: threading_modes <g2p model> <tts model> [requests] [concurrency]" << std::endl;
+        return 1;
+    }
+
+    std::string g2p_model = argv[1];
+    std::string tts_model = argv[2];
+    size_t requests = argc > 3 ? std::stoul(argv[3]) : 64;
+    size_t concurrency = argc > 4 ? std::stoul(argv[4]) : 0;
+
+    const std::vector<Configuration> configurations = {
+        {"latency", Babylon::ThreadingMode::LATENCY, false},
+        {"latency pinned", Babylon::ThreadingMode::LATENCY, true},
+        {"throughput", Babylon::ThreadingMode::THROUGHPUT, false},
+        {"throughput pinned", Babylon::ThreadingMode::THROUGHPUT, true},
+    };
+
+    // The parent never configures threading, so the default latency mode reports every usable core
+    size_t cores = Babylon::intra_op_threads();
+
+    std::cout << "cores " << cores << ", " << requests << " requests" << std::endl;
+    std::cout << std::left << std::setw(20) << "mode" << std::right
+              << std::setw(8) << "clients" << std::setw(10) << "req/s" << std::setw(12) << "audio s/s"
+              << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << std::endl;
+
+    for (const auto& configuration : configurations) {
+        // One client per core in throughput mode, latency mode serves requests one at a time
+        size_t clients = concurrency;
+        if (clients == 0) {
+            clients = configuration.mode == Babylon::ThreadingMode::THROUGHPUT ? cores : 1;
+        }
+
+        int results[2];
+        if (pipe(results) != 0) {
+            throw std::runtime_error("Failed to create pipe.");
+        }
+
+        if (fork() == 0) {
+            close(results[0]);
+
+            Result result = {1, 0, 0, 0, 0};
+            try {
+                result = run(configuration, g2p_model, tts_model, requests, clients);
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+
+            _exit(write(results[1], &result, sizeof(result)) == sizeof(result) ? 0 : 1);
+        }
+
+        // With the write end closed here, a child that crashes makes the read return at EOF
+        close(results[1]);
+
+        Result result;
+        bool received = read(results[0], &result, sizeof(result)) == sizeof(result);
+        wait(nullptr);
+        close(results[0]);
+
+        std::cout << std::left << std::setw(20) << configuration.name << std::right << std::setw(8) << clients;
+        if (!received || result.failed) {
+            std::cout << "  failed" << std::endl;
+            continue;
+        }
+
+        std::cout << std::fixed << std::setprecision(1)
+                  << std::setw(10) << result.requests_per_second << std::setw(12) << result.audio_per_second
+                  << std::setw(10) << result.p50 * 1000 << std::setw(10) << result.p95 * 1000 << std::endl;
+    }
+
+    return 0;
+}
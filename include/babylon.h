@@ -2,13 +2,27 @@
 #define BABYLON_H
 
 #ifdef __cplusplus
+#include <cstdio>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <deque>
+#include <list>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <onnxruntime_cxx_api.h>
 
 extern "C" {
+#else
+#include <stddef.h>
 #endif
 
 #ifdef WIN32
@@ -21,26 +35,387 @@ typedef struct {
    const char* language;
    const unsigned char use_dictionaries;
    const unsigned char use_punctuation;
+   const unsigned char use_shared_weights;
 } babylon_g2p_options_t;
 
+typedef struct {
+   const unsigned char use_shared_weights;
+} babylon_tts_options_t;
+
+typedef enum {
+   BABYLON_THREADING_LATENCY = 0,   // each request spreads over the whole thread pool
+   BABYLON_THREADING_THROUGHPUT     // each request runs single threaded, requests run side by side
+} babylon_threading_mode_t;
+
+typedef struct {
+   const babylon_threading_mode_t mode;
+   const unsigned int threads;          // 0 uses every core
+   const unsigned char pin_threads;
+   const int numa_node;                 // -1 for none
+} babylon_threading_options_t;
+
+// Must be called before the first babylon_g2p_init or babylon_tts_init, every session shares one thread pool.
+BABYLON_EXPORT int babylon_configure_threading(babylon_threading_options_t options);
+
+typedef struct {
+   const unsigned char lazy_load;        // read the metadata at init, load the model on first use
+   const unsigned int idle_timeout_ms;   // release models unused for this long, 0 keeps them loaded
+} babylon_memory_options_t;
+
+// Applies to babylon_g2p_init and babylon_tts_init calls made afterwards.
+BABYLON_EXPORT int babylon_configure_memory(babylon_memory_options_t options);
+
+// Resident bytes per component. Model sizes are the growth of the process while each model loaded,
+// 0 while it is released, the dictionary and cache sizes are estimates of their heap use.
+typedef struct {
+   size_t g2p_model;
+   size_t g2p_dictionaries;
+   size_t tts_model;
+   size_t tts_cache;
+   size_t process;
+} babylon_memory_usage_t;
+
+BABYLON_EXPORT babylon_memory_usage_t babylon_memory_usage(void);
+
+// Releases both models now, the next call loads them again.
+BABYLON_EXPORT void babylon_unload(void);
+
 BABYLON_EXPORT int babylon_g2p_init(const char* model_path, babylon_g2p_options_t options);
 
 BABYLON_EXPORT char* babylon_g2p(const char* text);
 
 BABYLON_EXPORT int* babylon_g2p_tokens(const char* text);
 
+// Same as above in any language the model supports, NULL selects the language given at init.
+BABYLON_EXPORT char* babylon_g2p_with_language(const char* text, const char* language);
+
+BABYLON_EXPORT int* babylon_g2p_tokens_with_language(const char* text, const char* language);
+
+// Phonemizes count texts in one batched call, languages may be NULL. Release with babylon_g2p_batch_free.
+BABYLON_EXPORT char** babylon_g2p_batch(const char** texts, const char** languages, size_t count);
+
+BABYLON_EXPORT void babylon_g2p_batch_free(char** results, size_t count);
+
+// Number of tokens before the -1 sentinel.
+BABYLON_EXPORT size_t babylon_tokens_length(const int* tokens);
+
+typedef struct babylon_g2p_stream babylon_g2p_stream_t;
+
+// Incremental G2P for text arriving in fragments, NULL selects the language given at init.
+// Streams must be freed before babylon_g2p_free.
+BABYLON_EXPORT babylon_g2p_stream_t* babylon_g2p_stream_create(const char* language);
+
+// Phonemes of the words the fragment completed, "" while a word is still open. Release with babylon_free.
+BABYLON_EXPORT char* babylon_g2p_stream_push(babylon_g2p_stream_t* stream, const char* fragment);
+
+// Phonemes of the trailing word, the stream can then take new text.
+BABYLON_EXPORT char* babylon_g2p_stream_finish(babylon_g2p_stream_t* stream);
+
+BABYLON_EXPORT void babylon_g2p_stream_free(babylon_g2p_stream_t* stream);
+
+// Replaces the pronunciation overrides of a language with a file of "word phoneme phoneme ..." lines,
+// NULL selects the language given at init. Overrides are consulted before the model dictionaries and
+// can be reloaded at any time, calls already running keep the entries they started with.
+BABYLON_EXPORT int babylon_g2p_lexicon_load(const char* path, const char* language);
+
+// Adds or replaces one override, phonemes are separated by spaces.
+BABYLON_EXPORT int babylon_g2p_lexicon_set(const char* word, const char* phonemes, const char* language);
+
+// With nonzero, words missing from the overrides and dictionaries are skipped and the model never runs.
+BABYLON_EXPORT int babylon_g2p_set_dictionary_only(int enabled);
+
+// Releases strings and token arrays returned by the babylon_g2p functions.
+BABYLON_EXPORT void babylon_free(void* ptr);
+
 BABYLON_EXPORT void babylon_g2p_free(void);
 
 BABYLON_EXPORT int babylon_tts_init(const char* model_path);
 
+BABYLON_EXPORT int babylon_tts_init_with_options(const char* model_path, babylon_tts_options_t options);
+
 BABYLON_EXPORT void babylon_tts(const char* text, const char* output_path);
 
+// Mono float PCM in [-1, 1] owned by the library, release it with babylon_audio_free.
+typedef struct {
+   float* samples;
+   size_t sample_count;
+   int sample_rate;
+} babylon_audio_t;
+
+// Receives PCM as it is synthesized, the samples are only valid during the call. Return nonzero to stop.
+typedef int (*babylon_audio_callback_t)(const float* samples, size_t count, void* user_data);
+
+BABYLON_EXPORT babylon_audio_t* babylon_tts_pcm(const char* text);
+
+// Returns 0 once all audio has been delivered, 1 on failure or when the callback stopped it.
+BABYLON_EXPORT int babylon_tts_stream(const char* text, babylon_audio_callback_t callback, void* user_data);
+
+BABYLON_EXPORT void babylon_audio_free(babylon_audio_t* audio);
+
+BABYLON_EXPORT int babylon_tts_sample_rate(void);
+
 BABYLON_EXPORT void babylon_tts_free(void);
 
+// Job status codes, BABYLON_JOB_CANCELLED and BABYLON_JOB_TIMED_OUT are also reported when a
+// job is stopped part way through synthesis.
+typedef enum {
+   BABYLON_JOB_PENDING = 0,
+   BABYLON_JOB_RUNNING,
+   BABYLON_JOB_DONE,
+   BABYLON_JOB_FAILED,
+   BABYLON_JOB_CANCELLED,
+   BABYLON_JOB_TIMED_OUT
+} babylon_job_status_t;
+
+typedef struct babylon_job babylon_job_t;
+
+// Called from a worker thread once the job has finished, failed, been cancelled or timed out.
+typedef void (*babylon_job_callback_t)(babylon_job_t* job, babylon_job_status_t status, void* user_data);
+
+// Async calls return immediately with a job handle that must be released with babylon_job_free.
+// A timeout_ms of 0 means no deadline, callback may be NULL when the job is polled or waited on.
+// Freeing a job that has no callback cancels it.
+BABYLON_EXPORT babylon_job_t* babylon_g2p_async(const char* text, babylon_job_callback_t callback, void* user_data, unsigned int timeout_ms);
+
+BABYLON_EXPORT babylon_job_t* babylon_tts_async(const char* text, const char* output_path, babylon_job_callback_t callback, void* user_data, unsigned int timeout_ms);
+
+BABYLON_EXPORT babylon_job_status_t babylon_job_status(babylon_job_t* job);
+
+BABYLON_EXPORT babylon_job_status_t babylon_job_wait(babylon_job_t* job);
+
+BABYLON_EXPORT void babylon_job_cancel(babylon_job_t* job);
+
+// Phonemes produced by a finished babylon_g2p_async job, owned by the job.
+BABYLON_EXPORT const char* babylon_job_result(babylon_job_t* job);
+
+BABYLON_EXPORT void babylon_job_free(babylon_job_t* job);
+
+// Number of jobs waiting for a worker, useful for load shedding.
+BABYLON_EXPORT size_t babylon_queue_depth(void);
+
 #ifdef __cplusplus
 }
 
+namespace Babylon {
+  // Fixed size worker pool, 0 threads sizes it to the host. Pinned workers each stay on one core.
+  class ThreadPool {
+    public:
+      ThreadPool(size_t threads = 0, bool pin = false);
+      ~ThreadPool();
+
+      void enqueue(std::function<void()> task);
+      size_t queue_depth() const;
+      size_t size() const;
+
+    private:
+      std::vector<std::thread> workers;
+      std::deque<std::function<void()>> tasks;
+      mutable std::mutex mutex;
+      std::condition_variable condition;
+      bool stopping;
+
+      void work();
+  };
+
+  // Thrown when a request is cancelled or runs past its deadline.
+  class Cancelled : public std::runtime_error {
+    public:
+      Cancelled(bool timed_out);
+      bool is_timeout() const;
+
+    private:
+      bool timed_out;
+  };
+
+  // Shared between a request and whoever may stop it. Sessions check it between words and
+  // chunks, and in-flight ORT runs are terminated on cancel or when the deadline passes.
+  class CancellationToken {
+    public:
+      CancellationToken();
+      ~CancellationToken();
+
+      void cancel();
+      void set_deadline(std::chrono::steady_clock::time_point deadline);
+      bool is_cancelled() const;
+      void check() const;
+
+      void attach(Ort::RunOptions* options);
+      void detach(Ort::RunOptions* options);
+      void terminate_runs();
+
+    private:
+      std::atomic<bool> cancelled;
+      std::chrono::steady_clock::time_point deadline;
+      bool has_deadline;
+      std::mutex mutex;
+      std::vector<Ort::RunOptions*> runs;
+
+      bool is_expired() const;
+  };
+
+  std::vector<Ort::Value> run(Ort::Session* session, const char* const* input_names, const Ort::Value* input_tensors, size_t input_count, const char* const* output_names, size_t output_count, CancellationToken* token = nullptr);
+
+  struct ModelOptions {
+    // Map an ORT format model read-only and run from the mapping, so processes loading the
+    // same file share its weights through the page cache instead of each holding a copy.
+    bool shared_weights = false;
+
+    // Only read the metadata at construction and release the model until its first use.
+    bool lazy_load = false;
+
+    // Release a model that has not run for this long, the next use loads it again. 0 keeps it loaded.
+    // An idle G2P session also drops the dictionaries it parsed, like DeepPhonemizer::Session::unload.
+    std::chrono::milliseconds idle_timeout{0};
+  };
+
+  enum class ThreadingMode {
+    THROUGHPUT, // every run is single threaded and requests run side by side
+    LATENCY     // every run spreads over the whole pool, requests take turns
+  };
+
+  struct ThreadingOptions {
+    ThreadingMode mode = ThreadingMode::LATENCY;
+    size_t threads = 0;       // 0 uses every core, or every core of numa_node
+    bool pin_threads = false; // keep each pool thread on one core
+    int numa_node = -1;       // Linux only, pin the threads to one node's cores
+  };
+
+  // All sessions share one ORT environment whose global thread pool is sized by these options,
+  // so they must be set before the first session is created. Throws if numa_node has no cores.
+  void configure_threading(const ThreadingOptions& options);
+  ThreadingOptions get_threading();
+  const Ort::Env& get_env();
+  void use_global_threads(Ort::SessionOptions& session_options);
+
+  size_t intra_op_threads();
+  // How many requests (or segments of one request) are worth running at once in the configured mode.
+  size_t request_parallelism();
+  // In throughput mode the request threads do the work, so they are the ones pinned.
+  bool pin_request_threads();
+  void pin_thread(size_t index);
+
+  class MappedFile {
+    public:
+      MappedFile(const std::string& path);
+      ~MappedFile();
+
+      MappedFile(const MappedFile&) = delete;
+      MappedFile& operator=(const MappedFile&) = delete;
+
+      const void* get_data() const;
+      size_t get_size() const;
+
+    private:
+      void* data;
+      size_t size;
+  };
+
+  // The mapping, if one was made, must outlive the returned session.
+  Ort::Session* load_session(const Ort::Env& env, const std::string& model_path, Ort::SessionOptions& session_options, const ModelOptions& options, MappedFile** mapping);
+
+  // An ORT session loaded on demand that can be released while idle. Runs hold the session they
+  // acquired, so a release only frees it once they finish. With an idle timeout a background
+  // thread releases the session after it has gone unused for that long.
+  class ModelHandle {
+    public:
+      ModelHandle(const std::string& model_path, const Ort::SessionOptions& session_options, const ModelOptions& options);
+      ~ModelHandle();
+
+      ModelHandle(const ModelHandle&) = delete;
+      ModelHandle& operator=(const ModelHandle&) = delete;
+
+      std::shared_ptr<Ort::Session> acquire();
+      void release();
+      // Releases the session if no run holds it and it has been unused for the idle timeout.
+      bool release_if_idle();
+      bool is_loaded() const;
+
+      // Runs after every release, so sessions can drop what they derived from the model.
+      void set_on_release(std::function<void()> callback);
+
+      // Growth of the resident set while the model loaded, 0 while it is released.
+      size_t get_resident_bytes() const;
+      size_t get_load_count() const;
+
+    private:
+      std::string model_path;
+      Ort::SessionOptions session_options;
+      ModelOptions options;
+
+      mutable std::mutex mutex;
+      std::shared_ptr<Ort::Session> session;
+      std::chrono::steady_clock::time_point last_used;
+      size_t resident_bytes;
+      size_t load_count;
+      std::function<void()> on_release;
+  };
+
+  // Resident set size of this process in bytes, 0 where it cannot be read.
+  size_t resident_bytes();
+
+  std::string lookup_metadata(const Ort::ModelMetadata& model_metadata, const char* key, const std::string& fallback);
+
+  // Reads the "quantization" metadata written by the export scripts (fp32, fp16, int8_dynamic or int8_static).
+  std::string detect_quantization(Ort::Session* session);
+
+  enum class AudioFormat {
+    PCM16,
+    PCM24,
+    FLOAT32
+  };
+
+  enum class AudioContainer {
+    WAV,
+    RAW
+  };
+
+  // Receives each encoded chunk as it is flushed.
+  using AudioSink = std::function<void(const char* data, size_t size)>;
+
+  // Streams audio to a file ("-" for stdout) or a sink, flushing in fixed size chunks as samples arrive.
+  // WAV sizes are patched on close when the output is seekable.
+  class AudioWriter {
+    public:
+      AudioWriter(const std::string& output_path, int sample_rate, AudioFormat format = AudioFormat::PCM16, AudioContainer container = AudioContainer::WAV, int channels = 1, size_t chunk_size = 1 << 16);
+      AudioWriter(AudioSink sink, int sample_rate, AudioFormat format = AudioFormat::PCM16, AudioContainer container = AudioContainer::WAV, int channels = 1, size_t chunk_size = 1 << 16);
+      ~AudioWriter();
+
+      AudioWriter(const AudioWriter&) = delete;
+      AudioWriter& operator=(const AudioWriter&) = delete;
+
+      void write(const float* samples, size_t count, float gain = 1.0f);
+      void write_silence(size_t count);
+      void flush();
+      void close();
+
+      uint64_t samples_written() const;
+      int get_sample_rate() const;
+
+    private:
+      int sample_rate;
+      int channels;
+      size_t sample_width;
+      AudioFormat format;
+      AudioContainer container;
+      std::FILE* file;
+      bool owns_file;
+      AudioSink sink;
+      bool open = false;
+      std::vector<char> buffer;
+      size_t buffer_used;
+      uint64_t data_size;
+
+      void start(size_t chunk_size);
+      void encode_header(uint8_t* out, uint32_t data_size) const;
+  };
+}
+
 namespace DeepPhonemizer {
+  struct Segment {
+    std::string text;
+    float pause; // seconds of silence after the segment
+  };
+
   class SequenceTokenizer {
     public:
       SequenceTokenizer(const std::vector<std::string>& symbols, const std::vector<std::string>& languages, int char_repeats, bool lowercase = true, bool append_start_end = true);
@@ -61,27 +436,145 @@ namespace DeepPhonemizer {
       std::unordered_set<std::string> special_tokens;
   };
 
+  // User pronunciations, such as brand names, consulted before the model dictionaries. Lookups read an
+  // immutable snapshot without locking; every update copies it, applies the change and swaps the new
+  // snapshot in, so calls already running finish on the old entries and no reader ever waits.
+  class Lexicon {
+    public:
+      struct Stats {
+        uint64_t lookups;
+        uint64_t hits;
+        uint64_t reloads;
+        size_t entries;
+      };
+
+      Lexicon();
+
+      // Replaces the entries of a language with "word phoneme phoneme ..." lines, '#' starts a comment.
+      void load(const std::string& path, const std::string& language);
+      void set(const std::string& word, const std::vector<std::string>& phonemes, const std::string& language);
+      bool remove(const std::string& word, const std::string& language);
+      void clear();
+
+      // Entries with phonemes outside this set are rejected by load and set, an empty set accepts any.
+      // Set once before the lexicon is shared, the session passes the phonemes its model can emit.
+      void set_phonemes(const std::vector<std::string>& phonemes);
+
+      bool lookup(const std::string& word, const std::string& language, std::vector<std::string>& phonemes) const;
+      Stats get_stats() const;
+
+      // Lowercase without punctuation, the key used by the lexicon and the model dictionaries.
+      static std::string normalize(const std::string& word);
+
+    private:
+      using Entries = std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>>;
+
+      // Only read and replaced through std::atomic_load and std::atomic_store
+      std::shared_ptr<const Entries> entries;
+      std::mutex update_mutex;
+      mutable std::atomic<uint64_t> lookups;
+      mutable std::atomic<uint64_t> hits;
+      std::atomic<uint64_t> reloads;
+      std::unordered_set<std::string> known_phonemes;
+
+      void update(const std::function<void(Entries&)>& change);
+      const std::string* find_unknown(const std::vector<std::string>& phonemes) const;
+  };
+
   class Session {
     public:
-      Session(const std::string& model_path, const std::string language = "en_us", const bool use_dictionaries = true, const bool use_punctuation = false);
+      Session(const std::string& model_path, const std::string language = "en_us", const bool use_dictionaries = true, const bool use_punctuation = false, const Babylon::ModelOptions& options = {});
       ~Session();
 
-      std::vector<std::string> g2p(const std::string& text);
-      std::vector<int64_t> g2p_tokens(const std::string& text);
+      std::vector<std::string> g2p(const std::string& text, Babylon::CancellationToken* token = nullptr);
+      std::vector<std::string> g2p(const std::string& text, const std::string& language, Babylon::CancellationToken* token = nullptr);
+      std::vector<int64_t> g2p_tokens(const std::string& text, Babylon::CancellationToken* token = nullptr);
+      std::vector<int64_t> g2p_tokens(const std::string& text, const std::string& language, Babylon::CancellationToken* token = nullptr);
+
+      // Each text is phonemized in its own language, words missing from the dictionaries share model runs.
+      std::vector<std::vector<std::string>> g2p_batch(const std::vector<std::string>& texts, const std::vector<std::string>& languages, Babylon::CancellationToken* token = nullptr);
+      std::vector<std::vector<int64_t>> g2p_tokens_batch(const std::vector<std::string>& texts, const std::vector<std::string>& languages, Babylon::CancellationToken* token = nullptr);
+
+      const std::string& get_language() const;
+      const std::vector<std::string>& get_languages() const;
+      const std::string& get_quantization() const;
+
+      // Overrides take effect for the next word looked up, including calls already running.
+      Lexicon& get_lexicon();
+
+      // Words missing from the lexicon and dictionaries are skipped instead of running the model.
+      void set_dictionary_only(bool dictionary_only);
+      bool is_dictionary_only() const;
+      uint64_t get_skipped_words() const;
+
+      // Releases the model now and drops the parsed dictionaries, the next call loads the model again.
+      // With lazy_load or idle_timeout the dictionaries are parsed again from metadata kept at
+      // construction, without the model, otherwise from the model loaded again.
+      void unload();
+      bool is_loaded() const;
+      size_t get_model_bytes() const;
+      // Estimated heap used by the dictionary metadata and the dictionaries parsed so far.
+      size_t get_dictionary_bytes() const;
 
     private:
+      using Dictionary = std::unordered_map<std::string, std::vector<std::string>>;
+
       std::string language;
+      std::vector<std::string> languages;
+      std::string quantization;
       bool use_dictionaries;
       bool use_punctuation;
-      Ort::Session* session;
+      std::atomic<bool> dictionary_only;
+      std::atomic<uint64_t> skipped_words;
+      Lexicon lexicon;
+      size_t max_batch_size;
+      std::unique_ptr<Babylon::ModelHandle> model;
       SequenceTokenizer* text_tokenizer;
       SequenceTokenizer* phoneme_tokenizer;
-      std::unordered_map<std::string, std::unordered_map<std::string, std::vector<std::string>>> dictionaries;
+      // <language>_dictionary metadata of models that get released, fixed after construction. Empty for models
+      // kept loaded, which read the metadata again when a dictionary is parsed.
+      std::unordered_map<std::string, std::string> dictionary_sources;
+      std::unordered_map<std::string, std::shared_ptr<const Dictionary>> dictionaries;
+      mutable std::mutex dictionaries_mutex;
+
+      bool lookup_dictionary(const std::string& word, const std::string& language, std::vector<int64_t>& tokens);
+      void to_tokens(const std::vector<std::string>& phonemes, std::vector<int64_t>& tokens) const;
+      std::shared_ptr<const Dictionary> get_dictionary(const std::string& language);
+      std::vector<std::vector<int64_t>> g2p_tokens_internal(const std::vector<std::string>& words, const std::vector<std::string>& languages, Babylon::CancellationToken* token);
+  };
+
+  // Phonemizes text that arrives in fragments, such as tokens from a language model. Words are
+  // emitted once the whitespace after them has arrived, only the trailing partial word is held back.
+  // Not thread safe, use one per stream. The session must outlive it.
+  class StreamingSession {
+    public:
+      StreamingSession(Session& session, const std::string& language = "");
+
+      // Phonemes of the words this fragment completed, empty while a word is still open.
+      std::vector<std::string> push(std::string_view fragment, Babylon::CancellationToken* token = nullptr);
+      // Phonemes of the trailing word, the stream can be reused afterwards.
+      std::vector<std::string> finish(Babylon::CancellationToken* token = nullptr);
+      void reset();
+
+      const std::string& get_pending() const;
 
-      std::vector<int64_t> g2p_tokens_internal(const std::string& text);
+    private:
+      Session& session;
+      std::string language;
+      std::string pending;
+
+      std::vector<std::string> phonemize(const std::string& text, Babylon::CancellationToken* token);
   };
 
+  // Splits text into sentences and clauses, skipping abbreviations, initials, decimals and
+  // separators inside numbers. Each segment carries the pause that should follow it.
+  std::vector<Segment> segment_text(const std::string& text, const std::string& language = "en_us");
+
   std::vector<std::string> clean_text(const std::string& text);
+  std::vector<std::string> clean_text(const std::string& text, const std::string& language);
+
+  // Appends the normalized words without allocating, views point into text or the static expansion tables.
+  void clean_text(std::string_view text, std::string_view language, std::vector<std::string_view>& words);
 }
 
 namespace Vits {
@@ -94,19 +587,71 @@ namespace Vits {
       std::unordered_map<std::string, int> token_to_idx;
   };
 
+  // Loads a full VITS graph, or the encoder of a split model whose "decoder" metadata names the
+  // vocoder. Split models stream audio window by window as the decoder produces it.
   class Session {
     public:
-      Session(const std::string& model_path);
+      Session(const std::string& model_path, const Babylon::ModelOptions& options = {});
       ~Session();
 
-      void tts(const std::vector<std::string>& phonemes, const std::string& output_path);
+      void tts(const std::vector<std::string>& phonemes, const std::string& output_path, Babylon::CancellationToken* token = nullptr);
+      void tts(const std::vector<std::string>& phonemes, Babylon::AudioWriter& writer, Babylon::CancellationToken* token = nullptr);
+
+      // Writes the segments in order with each pause as silence after its segment. Up to parallelism
+      // segments are synthesized at once, edges are faded and a shared gain keeps the loudness even.
+      void tts(const std::vector<std::vector<std::string>>& segments, const std::vector<float>& pauses, Babylon::AudioWriter& writer, Babylon::CancellationToken* token = nullptr, size_t parallelism = 1);
+
+      int get_sample_rate() const;
+      const std::string& get_quantization() const;
+      bool is_split() const;
+
+      // Releases the model(s) and cached latents now, the next call loads them again.
+      void unload();
+      bool is_loaded() const;
+      size_t get_model_bytes() const;
+      size_t get_cache_bytes() const;
+
+      // Largest difference between the windowed decode used for streaming and decoding the whole latent
+      // at once, relative to the peak. Checks the decoder_window and decoder_overlap of a split model.
+      float decoder_error(const std::vector<std::string>& phonemes, Babylon::CancellationToken* token = nullptr);
 
     private:
+      // Encoder output of a split model, [1, channels, frames]
+      struct Latent {
+        Ort::Value value;
+        int64_t channels;
+        int64_t frames;
+      };
+
       int sample_rate;
+      std::string quantization;
       std::vector<float> scales;
 
-      Ort::Session* session;
+      std::unique_ptr<Babylon::ModelHandle> model;
       SequenceTokenizer* phoneme_tokenizer;
+      std::string output_name;
+
+      std::unique_ptr<Babylon::ModelHandle> decoder;
+      std::string decoder_input_name;
+      std::string decoder_output_name;
+      int64_t hop_length;
+      int64_t decoder_window;
+      int64_t decoder_overlap;
+
+      // Most recently used first, keyed by the phoneme ID bytes
+      std::list<std::pair<std::string, std::shared_ptr<const Latent>>> encoder_cache;
+      std::unordered_map<std::string, std::list<std::pair<std::string, std::shared_ptr<const Latent>>>::iterator> encoder_cache_index;
+      mutable std::mutex encoder_cache_mutex;
+
+      void clear_encoder_cache();
+
+      Ort::Value infer(const std::vector<int64_t>& phoneme_ids, Babylon::CancellationToken* token);
+      std::shared_ptr<const Latent> encode(const std::vector<std::string>& phonemes, Babylon::CancellationToken* token);
+      Ort::Value decode(const Latent& latent, int64_t start, int64_t end, Babylon::CancellationToken* token);
+      Ort::Value decode_window(const Latent& latent, int64_t start, int64_t& offset, int64_t& count, Babylon::CancellationToken* token);
+      void stream(const Latent& latent, float& stream_peak, int64_t fade, Babylon::AudioWriter& writer, Babylon::CancellationToken* token);
+      float peak(const float* audio, int64_t count) const;
+      void write(const float* audio, int64_t count, float gain, int64_t fade_in, int64_t fade_out, Babylon::AudioWriter& writer, Babylon::CancellationToken* token, int64_t ramp = 0, float ramp_gain = 0.0f) const;
   };
 }
 #endif
@@ -0,0 +1,200 @@
+"""
+Compares quantized babylon.cpp models against their FP32 export.
+
+DeepPhonemizer models are scored on dictionary words (phoneme error rate against the
+dictionary and agreement with the first model), VITS models on seeded phoneme sequences
+(real time factor and SNR against the first model with noise disabled so runs are
+deterministic). Every model runs in its own process so peak memory is not shared.
+
+python benchmark_quantization.py \
+    --dp deep_phonemizer.onnx deep_phonemizer_dynamic.onnx deep_phonemizer_static.onnx \
+    --vits amy.onnx amy_dynamic.onnx amy_fp16.onnx
+"""
+
+import argparse
+import multiprocessing
+import random
+import resource
+import sys
+import time
+import numpy as np
+import onnxruntime as ort
+
+def peak_rss_mb():
+    peak = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
+    return peak / (1024 * 1024) if sys.platform == 'darwin' else peak / 1024
+
+def metadata(session):
+    return session.get_modelmeta().custom_metadata_map
+
+def edit_distance(a, b):
+    row = list(range(len(b) + 1))
+    for i, x in enumerate(a, 1):
+        previous, row[0] = row[0], i
+        for j, y in enumerate(b, 1):
+            previous, row[j] = row[j], min(row[j] + 1, row[j - 1] + 1, previous + (x != y))
+    return row[-1]
+
+def session_options(threads):
+    options = ort.SessionOptions()
+    options.intra_op_num_threads = threads
+    return options
+
+# Mirrors DeepPhonemizer::SequenceTokenizer in src/phonemizer.cpp
+class SequenceTokenizer:
+    def __init__(self, symbols, languages, char_repeats, lowercase):
+        self.tokens = [' '] + [f'<{language}>' for language in languages] + ['<end>'] + symbols
+        self.index = {token: i for i, token in reversed(list(enumerate(self.tokens)))}
+        self.end_index = len(languages) + 1
+        self.special = {0, self.end_index} | set(range(1, len(languages) + 1))
+        self.char_repeats = char_repeats
+        self.lowercase = lowercase
+
+    def encode(self, word, language):
+        word = word.lower() if self.lowercase else word
+        sequence = [self.index[c] for c in word if c in self.index for _ in range(self.char_repeats)]
+        sequence = ([self.index[f'<{language}>']] + sequence + [self.end_index])[:50]
+        return sequence + [0] * (50 - len(sequence))
+
+    def decode(self, sequence):
+        cleaned = []
+        for token in sequence:
+            if token == self.end_index:
+                break
+            if token in self.special or (cleaned and cleaned[-1] == token):
+                continue
+            cleaned.append(token)
+        return [self.tokens[token] for token in cleaned]
+
+def run_dp(model_path, words, threads, queue):
+    session = ort.InferenceSession(model_path, session_options(threads), providers=['CPUExecutionProvider'])
+    meta = metadata(session)
+    languages = meta['languages'].split()
+    text_tokenizer = SequenceTokenizer(meta['text_symbols'].split(), languages, int(meta['char_repeats']), meta['lowercase'] == '1')
+    phoneme_tokenizer = SequenceTokenizer(meta['phoneme_symbols'].split(), languages, 1, False)
+
+    predictions = []
+    start = time.perf_counter()
+    for language, word, _ in words:
+        output = session.run(['output'], {'text': np.array([text_tokenizer.encode(word, language)], dtype=np.int64)})[0]
+        predictions.append(phoneme_tokenizer.decode(output[0].argmax(-1).tolist()))
+    elapsed = time.perf_counter() - start
+
+    queue.put({
+        'quantization': meta.get('quantization', 'fp32'),
+        'predictions': predictions,
+        'us_per_word': elapsed / len(words) * 1e6,
+        'peak_rss_mb': peak_rss_mb(),
+    })
+
+def run_vits(model_path, sequences, threads, queue):
+    session = ort.InferenceSession(model_path, session_options(threads), providers=['CPUExecutionProvider'])
+    meta = metadata(session)
+    sample_rate = int(meta['sample_rate'])
+    scales = np.array([0.0, float(meta['length_scale']), 0.0], dtype=np.float32)
+
+    outputs = []
+    audio_seconds = 0.0
+    start = time.perf_counter()
+    for sequence in sequences:
+        audio = session.run(['output'], {
+            'input': np.array([sequence], dtype=np.int64),
+            'input_lengths': np.array([len(sequence)], dtype=np.int64),
+            'scales': scales,
+        })[0].reshape(-1)
+        audio_seconds += len(audio) / sample_rate
+        outputs.append(audio)
+    elapsed = time.perf_counter() - start
+
+    queue.put({
+        'quantization': meta.get('quantization', 'fp32'),
+        'outputs': outputs,
+        'rtf': elapsed / audio_seconds,
+        'peak_rss_mb': peak_rss_mb(),
+    })
+
+# Spawned rather than forked so no ORT threads from the parent are inherited
+def in_process(target, *args):
+    context = multiprocessing.get_context('spawn')
+    queue = context.Queue()
+    process = context.Process(target=target, args=(*args, queue))
+    process.start()
+    result = queue.get()
+    process.join()
+    return result
+
+def load_words(model_path, count):
+    meta = metadata(ort.InferenceSession(model_path, providers=['CPUExecutionProvider']))
+    words = []
+    for language in meta['languages'].split():
+        for line in meta.get(f'{language}_dictionary', '').splitlines():
+            parts = line.split()
+            if len(parts) > 1:
+                words.append((language, parts[0], parts[1:]))
+    random.seed(0)
+    return random.sample(words, min(count, len(words)))
+
+def load_sequences(model_path, count):
+    meta = metadata(ort.InferenceSession(model_path, providers=['CPUExecutionProvider']))
+    ids = [int(i) for i in meta['phoneme_ids'].split() if int(i) > 2]
+    random.seed(0)
+    sequences = []
+    for _ in range(count):
+        sequence = [1, 0]
+        for _ in range(random.randint(20, 150)):
+            sequence += [random.choice(ids), 0]
+        sequences.append(sequence + [2])
+    return sequences
+
+def snr_db(reference, audio):
+    length = min(len(reference), len(audio))
+    noise = np.sum((reference[:length] - audio[:length]) ** 2)
+    return 10 * np.log10(np.sum(reference[:length] ** 2) / max(noise, 1e-12))
+
+def benchmark_dp(models, count, threads):
+    words = load_words(models[0], count)
+    print(f'\nDeepPhonemizer: {len(words)} dictionary words, {threads} thread(s)')
+    print(f'{"model":40} {"quant":>12} {"us/word":>10} {"PER %":>8} {"agree %":>8} {"peak MB":>9}')
+
+    reference = None
+    for model in models:
+        result = in_process(run_dp, model, words, threads)
+        if reference is None:
+            reference = result['predictions']
+
+        errors = sum(edit_distance(predicted, expected) for predicted, (_, _, expected) in zip(result['predictions'], words))
+        per = errors / sum(len(expected) for _, _, expected in words) * 100
+        agreement = sum(a == b for a, b in zip(result['predictions'], reference)) / len(words) * 100
+
+        print(f'{model:40} {result["quantization"]:>12} {result["us_per_word"]:>10.1f} {per:>8.2f} {agreement:>8.1f} {result["peak_rss_mb"]:>9.1f}')
+
+def benchmark_vits(models, count, threads):
+    sequences = load_sequences(models[0], count)
+    print(f'\nVITS: {len(sequences)} phoneme sequences, {threads} thread(s), noise disabled')
+    print(f'{"model":40} {"quant":>12} {"RTF":>8} {"SNR dB":>8} {"len diff %":>10} {"peak MB":>9}')
+
+    reference = None
+    for model in models:
+        result = in_process(run_vits, model, sequences, threads)
+        if reference is None:
+            reference = result['outputs']
+
+        snr = np.mean([snr_db(r, a) for r, a in zip(reference, result['outputs'])])
+        length_diff = np.mean([abs(len(a) - len(r)) / len(r) for r, a in zip(reference, result['outputs'])]) * 100
+
+        print(f'{model:40} {result["quantization"]:>12} {result["rtf"]:>8.3f} {snr:>8.1f} {length_diff:>10.2f} {result["peak_rss_mb"]:>9.1f}')
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Compare quantized babylon.cpp models against FP32, the first model of each kind is the reference')
+    parser.add_argument('--dp', nargs='+', default=[], help='DeepPhonemizer models')
+    parser.add_argument('--vits', nargs='+', default=[], help='VITS models')
+    parser.add_argument('--words', type=int, default=1000)
+    parser.add_argument('--sequences', type=int, default=20)
+    parser.add_argument('--threads', type=int, default=1)
+    args = parser.parse_args()
+
+    if args.dp:
+        benchmark_dp(args.dp, args.words, args.threads)
+
+    if args.vits:
+        benchmark_vits(args.vits, args.sequences, args.threads)
@@ -1,7 +1,20 @@
+import argparse
+import random
+import numpy as np
 import torch
 import onnx
 from dp.model.model import AutoregressiveTransformer, ForwardTransformer, load_checkpoint
 
+parser = argparse.ArgumentParser(description='Export a DeepPhonemizer checkpoint to ONNX for babylon.cpp')
+parser.add_argument(
+    '--quantize',
+    choices=['none', 'dynamic', 'static', 'fp16'],
+    default='none',
+    help='Also write a quantized copy: dynamic/static INT8 or FP16 weights'
+)
+parser.add_argument('--calibration-words', type=int, default=500, help='Dictionary words used to calibrate static INT8')
+args = parser.parse_args()
+
 # Load your model checkpoint
 checkpoint_path = './latin_ipa_forward.pt'
 model, torch_meta = load_checkpoint(checkpoint_path)
@@ -60,7 +73,8 @@ wrapped_model = WrapperModule(model)
 # Set model to evaluation mode
 wrapped_model.eval()
 
-# Convert model to ONNX format with fixed input shape
+# Convert model to ONNX format with fixed sequence length, the batch axis stays dynamic so
+# babylon.cpp can phonemize every word of a request (in any mix of languages) in one run
 onnx_file_path = './deep_phonemizer.onnx'
 torch.onnx.export(
     wrapped_model,
@@ -68,7 +82,8 @@ torch.onnx.export(
     f=onnx_file_path,
     opset_version=14,
     input_names=input_names,
-    output_names=['output']
+    output_names=['output'],
+    dynamic_axes={'text': {0: 'batch'}, 'output': {0: 'batch'}}
 )
 
 # Verify the ONNX model
@@ -106,7 +121,8 @@ metadata = {
     "phoneme_symbols": phoneme_symbols,
     "char_repeats": char_repeats,
     "lowercase": lowercase,
-    "n_val": n_val
+    "n_val": n_val,
+    "quantization": "fp32"
 }
 
 for language in preprocessing['languages']:
@@ -124,3 +140,63 @@ for key, value in metadata.items():
 onnx.save(onnx_model, onnx_file_path)
 onnx.checker.check_model(onnx_model)
 print(f"Model successfully converted to {onnx_file_path} with fixed input shape and metadata added")
+
+if args.quantize == 'none':
+    exit()
+
+from onnxruntime.quantization import CalibrationDataReader, QuantFormat, QuantType, quantize_dynamic, quantize_static
+
+# Feeds tokenized dictionary words through the model to pick activation ranges
+class DictionaryCalibrationReader(CalibrationDataReader):
+    def __init__(self, words):
+        text_tokenizer = torch_meta['preprocessor'].text_tokenizer
+        self.inputs = []
+        for language, word in words:
+            tokens = text_tokenizer(word, language)[:50]
+            tokens += [0] * (50 - len(tokens))
+            self.inputs.append({'text': np.array([tokens], dtype=np.int64)})
+        self.iterator = iter(self.inputs)
+
+    def get_next(self):
+        return next(self.iterator, None)
+
+quantized_file_path = f'./deep_phonemizer_{args.quantize}.onnx'
+
+if args.quantize == 'dynamic':
+    quantize_dynamic(onnx_file_path, quantized_file_path, weight_type=QuantType.QInt8)
+    quantization = 'int8_dynamic'
+elif args.quantize == 'static':
+    words = [(language, word) for language in preprocessing['languages'] for word in phoneme_dict[language].keys()]
+    random.seed(0)
+    words = random.sample(words, min(args.calibration_words, len(words)))
+
+    # QOperator keeps the integer kernels explicit so the model runs quantized at any graph optimization level
+    quantize_static(
+        onnx_file_path,
+        quantized_file_path,
+        DictionaryCalibrationReader(words),
+        quant_format=QuantFormat.QOperator,
+        per_channel=True,
+        weight_type=QuantType.QInt8
+    )
+    quantization = 'int8_static'
+else:
+    from onnxconverter_common import float16
+
+    # Inputs and outputs stay int64/float32 so the runtime feeds the model exactly as before
+    fp16_model = float16.convert_float_to_float16(onnx.load(onnx_file_path), keep_io_types=True)
+    onnx.save(fp16_model, quantized_file_path)
+    quantization = 'fp16'
+
+# Quantizers do not reliably carry metadata over, so write it again
+quantized_model = onnx.load(quantized_file_path)
+metadata["quantization"] = quantization
+del quantized_model.metadata_props[:]
+for key, value in metadata.items():
+    meta = quantized_model.metadata_props.add()
+    meta.key = key
+    meta.value = str(value)
+
+onnx.save(quantized_model, quantized_file_path)
+onnx.checker.check_model(quantized_model)
+print(f"Quantized model ({quantization}) written to {quantized_file_path}")
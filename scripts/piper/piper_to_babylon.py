@@ -1,8 +1,25 @@
+import argparse
 import json
+import random
+import numpy as np
 import onnx
 
+parser = argparse.ArgumentParser(description='Convert a Piper voice to a babylon.cpp VITS model')
+parser.add_argument(
+    '--quantize',
+    choices=['none', 'dynamic', 'static', 'fp16'],
+    default='none',
+    help='Also write a quantized copy: dynamic/static INT8 or FP16 weights'
+)
+parser.add_argument('--calibration-samples', type=int, default=64, help='Phoneme sequences used to calibrate static INT8')
+parser.add_argument('--split', action='store_true', help='Also write separate encoder and decoder models so audio can stream while it is decoded')
+parser.add_argument('--decoder-window', type=int, default=32, help='Latent frames the decoder turns into audio per run')
+parser.add_argument('--decoder-overlap', type=int, default=8, help='Latent frames of context decoded on each side of a window')
+args = parser.parse_args()
+
 onnx_file_path = './en_US-amy-medium.onnx'
 config_file_path = './en_US-amy-medium.onnx.json'
+output_file_path = './amy.onnx'
 
 # Verify the ONNX model
 onnx_model = onnx.load(onnx_file_path)
@@ -29,14 +46,164 @@ metadata = {
     "noise_scale": data['inference']['noise_scale'],
     "length_scale": data['inference']['length_scale'],
     "noise_w": data['inference']['noise_w'],
+    "quantization": "fp32",
 }
 
-for key, value in metadata.items():
-    meta = onnx_model.metadata_props.add()
-    meta.key = key
-    meta.value = str(value)
+# Replaces our keys and keeps any metadata the model already carries
+def write_metadata(model, metadata):
+    existing = [meta for meta in model.metadata_props if meta.key not in metadata]
+    del model.metadata_props[:]
+    model.metadata_props.extend(existing)
+    for key, value in metadata.items():
+        meta = model.metadata_props.add()
+        meta.key = key
+        meta.value = str(value)
+
+write_metadata(onnx_model, metadata)
 
-onnx.save(onnx_model, "./amy.onnx")
+onnx.save(onnx_model, output_file_path)
 onnx.checker.check_model(onnx_model)
 
-print("Metadata added successfully!")
\ No newline at end of file
+print("Metadata added successfully!")
+
+if args.split and args.quantize == 'static':
+    raise SystemExit('Static INT8 calibrates the full graph, it cannot be combined with --split')
+
+encoder_file_path = './amy_encoder.onnx'
+decoder_file_path = './amy_decoder.onnx'
+
+# The vocoder starts at dec.conv_pre, its input is the latent the encoder and duration predictor produce
+def find_latent(model):
+    for node in model.graph.node:
+        if node.op_type == 'Conv' and '/dec/conv_pre/' in node.name:
+            return node.input[0]
+    for node in model.graph.node:
+        if node.op_type == 'Conv' and 'dec.conv_pre.weight' in node.input:
+            return node.input[0]
+    raise SystemExit('Decoder input not found, is this a Piper VITS model?')
+
+# Audio samples per latent frame, the product of the decoder upsampling strides
+def find_hop_length(model):
+    hop_length = 1
+    for node in model.graph.node:
+        if node.op_type == 'ConvTranspose' and ('/dec/' in node.name or any(name.startswith('dec.') for name in node.input)):
+            strides = next((list(attribute.ints) for attribute in node.attribute if attribute.name == 'strides'), [1])
+            hop_length *= strides[0]
+    return hop_length
+
+def split_model(model, encoder_path, decoder_path, metadata):
+    if any(graph_input.name == 'sid' for graph_input in model.graph.input):
+        raise SystemExit('Multi-speaker voices condition the decoder on the speaker and cannot be split')
+
+    latent = find_latent(model)
+
+    # The extractor needs a type for the cut, shape inference cannot always give one through the flow
+    model = onnx.shape_inference.infer_shapes(model)
+    if latent not in {value.name for value in model.graph.value_info}:
+        model.graph.value_info.append(onnx.helper.make_tensor_value_info(latent, onnx.TensorProto.FLOAT, [1, None, None]))
+
+    extractor = onnx.utils.Extractor(model)
+    encoder = extractor.extract_model(['input', 'input_lengths', 'scales'], [latent])
+    decoder = extractor.extract_model([latent], ['output'])
+
+    encoder_metadata = dict(metadata)
+    encoder_metadata.update({
+        "decoder": decoder_path.split('/')[-1],
+        "hop_length": find_hop_length(model),
+        "decoder_window": args.decoder_window,
+        "decoder_overlap": args.decoder_overlap,
+    })
+    write_metadata(encoder, encoder_metadata)
+    write_metadata(decoder, {"quantization": metadata["quantization"]})
+
+    onnx.save(encoder, encoder_path)
+    onnx.save(decoder, decoder_path)
+    onnx.checker.check_model(encoder)
+    onnx.checker.check_model(decoder)
+
+if args.split:
+    split_model(onnx_model, encoder_file_path, decoder_file_path, metadata)
+    print(f"Split model written to {encoder_file_path} and {decoder_file_path}")
+
+if args.quantize == 'none':
+    exit()
+
+from onnxruntime.quantization import CalibrationDataReader, QuantFormat, QuantType, quantize_dynamic, quantize_static
+
+# Random phoneme sequences laid out the way Vits::SequenceTokenizer builds them (^ _ p _ p _ ... $)
+class PhonemeCalibrationReader(CalibrationDataReader):
+    def __init__(self, count):
+        random.seed(0)
+        ids = [num[0] for phoneme, num in phoneme_id_map.items() if phoneme not in ('_', '^', '$')]
+        scales = np.array([data['inference']['noise_scale'], data['inference']['length_scale'], data['inference']['noise_w']], dtype=np.float32)
+
+        self.inputs = []
+        for _ in range(count):
+            sequence = [1, 0]
+            for _ in range(random.randint(10, 120)):
+                sequence += [random.choice(ids), 0]
+            sequence.append(2)
+
+            self.inputs.append({
+                'input': np.array([sequence], dtype=np.int64),
+                'input_lengths': np.array([len(sequence)], dtype=np.int64),
+                'scales': scales,
+            })
+        self.iterator = iter(self.inputs)
+
+    def get_next(self):
+        return next(self.iterator, None)
+
+def quantize(input_path, output_path):
+    if args.quantize == 'dynamic':
+        quantize_dynamic(input_path, output_path, weight_type=QuantType.QInt8)
+        return 'int8_dynamic'
+
+    if args.quantize == 'static':
+        # QOperator keeps the integer kernels explicit, Vits::Session runs with graph optimizations disabled
+        quantize_static(
+            input_path,
+            output_path,
+            PhonemeCalibrationReader(args.calibration_samples),
+            quant_format=QuantFormat.QOperator,
+            per_channel=True,
+            weight_type=QuantType.QInt8
+        )
+        return 'int8_static'
+
+    from onnxconverter_common import float16
+
+    # Inputs and outputs stay float32/int64 so the runtime feeds the model exactly as before,
+    # which also keeps the latent between a split encoder and decoder in float32
+    fp16_model = float16.convert_float_to_float16(onnx.load(input_path), keep_io_types=True)
+    onnx.save(fp16_model, output_path)
+    return 'fp16'
+
+# Quantizers do not reliably carry metadata over, so write it again
+def rewrite_metadata(path, metadata):
+    model = onnx.load(path)
+    write_metadata(model, metadata)
+    onnx.save(model, path)
+    onnx.checker.check_model(model)
+
+quantized_file_path = f'./amy_{args.quantize}.onnx'
+quantization = quantize(output_file_path, quantized_file_path)
+
+metadata["quantization"] = quantization
+rewrite_metadata(quantized_file_path, metadata)
+
+print(f"Quantized model ({quantization}) written to {quantized_file_path}")
+
+if args.split:
+    # Each half is quantized on its own so the cut stays where the runtime expects it
+    quantized_encoder_path = f'./amy_encoder_{args.quantize}.onnx'
+    quantized_decoder_path = f'./amy_decoder_{args.quantize}.onnx'
+    quantize(encoder_file_path, quantized_encoder_path)
+    quantize(decoder_file_path, quantized_decoder_path)
+
+    encoder_metadata = {meta.key: meta.value for meta in onnx.load(encoder_file_path).metadata_props}
+    encoder_metadata.update({"quantization": quantization, "decoder": quantized_decoder_path.split('/')[-1]})
+    rewrite_metadata(quantized_encoder_path, encoder_metadata)
+    rewrite_metadata(quantized_decoder_path, {"quantization": quantization})
+
+    print(f"Quantized split model ({quantization}) written to {quantized_encoder_path} and {quantized_decoder_path}")
@@ -0,0 +1,332 @@
+#include "http.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static std::string to_lower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return std::tolower(c); });
+    return value;
+}
+
+static std::string trim(const std::string& value) {
+    size_t start = value.find_first_not_of(" \t");
+    size_t end = value.find_last_not_of(" \t\r");
+    return start == std::string::npos ? "" : value.substr(start, end - start + 1);
+}
+
+static addrinfo* resolve(const std::string& host, int port, bool passive) {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    addrinfo* result = nullptr;
+    int error = getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result);
+    if (error != 0) {
+        throw std::runtime_error("Failed to resolve " + host + ": " + gai_strerror(error));
+    }
+
+    return result;
+}
+
+namespace Http {
+    Connection::Connection(int fd) : fd(fd), buffer_start(0), has_read_deadline(false) {
+        // Audio is sent in small chunks, do not hold them back waiting for ACKs
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    Connection::~Connection() {
+        close(fd);
+    }
+
+    void Connection::set_read_deadline(std::chrono::steady_clock::time_point deadline) {
+        read_deadline = deadline;
+        has_read_deadline = true;
+    }
+
+    bool Connection::fill() {
+        if (buffer_start > 0) {
+            buffer.erase(0, buffer_start);
+            buffer_start = 0;
+        }
+
+        if (has_read_deadline) {
+            int ready;
+            do {
+                auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(read_deadline - std::chrono::steady_clock::now()).count();
+                pollfd descriptor = {fd, POLLIN, 0};
+                ready = poll(&descriptor, 1, static_cast<int>(std::max<decltype(remaining)>(remaining, 0)));
+            } while (ready < 0 && errno == EINTR);
+
+            if (ready == 0) {
+                throw Timeout("Timed out reading the request.");
+            }
+            if (ready < 0) {
+                throw std::runtime_error(std::string("Failed to wait for socket: ") + std::strerror(errno));
+            }
+        }
+
+        char data[16384];
+        ssize_t received;
+        do {
+            received = recv(fd, data, sizeof(data), 0);
+        } while (received < 0 && errno == EINTR);
+
+        if (received < 0) {
+            throw std::runtime_error(std::string("Failed to read from socket: ") + std::strerror(errno));
+        }
+
+        buffer.append(data, received);
+        return received > 0;
+    }
+
+    std::string Connection::read_line() {
+        size_t end;
+        while ((end = buffer.find("\r\n", buffer_start)) == std::string::npos) {
+            if (buffer.size() - buffer_start > 16384) {
+                throw std::runtime_error("Line too long.");
+            }
+            if (!fill()) {
+                throw std::runtime_error("Connection closed.");
+            }
+        }
+
+        std::string line = buffer.substr(buffer_start, end - buffer_start);
+        buffer_start = end + 2;
+        return line;
+    }
+
+    std::string Connection::read_exact(size_t size) {
+        while (buffer.size() - buffer_start < size) {
+            if (!fill()) {
+                throw std::runtime_error("Connection closed.");
+            }
+        }
+
+        std::string data = buffer.substr(buffer_start, size);
+        buffer_start += size;
+        return data;
+    }
+
+    std::string Connection::read_chunk() {
+        size_t size = std::stoul(read_line(), nullptr, 16);
+        std::string data = read_exact(size);
+        read_line();
+        return data;
+    }
+
+    void Connection::read_headers(std::unordered_map<std::string, std::string>& headers) {
+        for (std::string line = read_line(); !line.empty(); line = read_line()) {
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) {
+                throw std::runtime_error("Malformed header.");
+            }
+            headers[to_lower(line.substr(0, colon))] = trim(line.substr(colon + 1));
+        }
+    }
+
+    bool Connection::read_request(Request& request, size_t max_body) {
+        if (buffer.size() == buffer_start && !fill()) {
+            return false;
+        }
+
+        std::string line = read_line();
+        size_t first = line.find(' ');
+        size_t second = line.find(' ', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            throw std::runtime_error("Malformed request line.");
+        }
+
+        request.method = line.substr(0, first);
+        std::string target = line.substr(first + 1, second - first - 1);
+
+        size_t question = target.find('?');
+        request.path = target.substr(0, question);
+        if (question != std::string::npos) {
+            std::string query = target.substr(question + 1);
+            size_t start = 0;
+            while (start <= query.size()) {
+                size_t end = std::min(query.find('&', start), query.size());
+                std::string pair = query.substr(start, end - start);
+                size_t equals = pair.find('=');
+                if (!pair.empty()) {
+                    request.query[url_decode(pair.substr(0, equals))] = equals == std::string::npos ? "" : url_decode(pair.substr(equals + 1));
+                }
+                start = end + 1;
+            }
+        }
+
+        read_headers(request.headers);
+
+        auto length = request.headers.find("content-length");
+        if (length != request.headers.end()) {
+            size_t size = std::stoul(length->second);
+            if (size > max_body) {
+                throw std::length_error("Request body too large.");
+            }
+            request.body = read_exact(size);
+        }
+
+        return true;
+    }
+
+    Response Connection::read_response_head() {
+        Response response;
+
+        std::string line = read_line();
+        size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            throw std::runtime_error("Malformed status line.");
+        }
+        response.status = std::stoi(line.substr(space + 1, 3));
+
+        read_headers(response.headers);
+        return response;
+    }
+
+    void Connection::send(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t sent = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error(std::string("Failed to write to socket: ") + std::strerror(errno));
+            }
+
+            data += sent;
+            size -= sent;
+        }
+    }
+
+    void Connection::send(const std::string& data) {
+        send(data.data(), data.size());
+    }
+
+    void Connection::send_response(int status, const std::string& content_type, const std::string& body) {
+        send("HTTP/1.1 " + std::to_string(status) + " " + status_text(status) + "\r\n"
+             "Content-Type: " + content_type + "\r\n"
+             "Content-Length: " + std::to_string(body.size()) + "\r\n"
+             "Connection: close\r\n\r\n" + body);
+    }
+
+    void Connection::begin_chunked(int status, const std::string& content_type) {
+        send("HTTP/1.1 " + std::to_string(status) + " " + status_text(status) + "\r\n"
+             "Content-Type: " + content_type + "\r\n"
+             "Transfer-Encoding: chunked\r\n"
+             "Connection: close\r\n\r\n");
+    }
+
+    void Connection::send_chunk(const char* data, size_t size) {
+        if (size == 0) {
+            return;
+        }
+
+        char prefix[32];
+        int length = std::snprintf(prefix, sizeof(prefix), "%zx\r\n", size);
+
+        std::string chunk;
+        chunk.reserve(length + size + 2);
+        chunk.append(prefix, length).append(data, size).append("\r\n");
+        send(chunk);
+    }
+
+    void Connection::end_chunked() {
+        send("0\r\n\r\n");
+    }
+
+    int listen_on(const std::string& host, int port, int backlog) {
+        addrinfo* addresses = resolve(host, port, true);
+
+        int fd = -1;
+        for (addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd < 0) {
+                continue;
+            }
+
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+            if (bind(fd, address->ai_addr, address->ai_addrlen) != 0 || listen(fd, backlog) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo(addresses);
+
+        if (fd < 0) {
+            throw std::runtime_error("Failed to listen on " + host + ":" + std::to_string(port));
+        }
+
+        return fd;
+    }
+
+    int connect_to(const std::string& host, int port) {
+        addrinfo* addresses = resolve(host, port, false);
+
+        int fd = -1;
+        for (addrinfo* address = addresses; address != nullptr && fd < 0; address = address->ai_next) {
+            fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) != 0) {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        freeaddrinfo(addresses);
+
+        if (fd < 0) {
+            throw std::runtime_error("Failed to connect to " + host + ":" + std::to_string(port));
+        }
+
+        return fd;
+    }
+
+    std::string status_text(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 400: return "Bad Request";
+            case 404: return "Not Found";
+            case 405: return "Method Not Allowed";
+            case 408: return "Request Timeout";
+            case 413: return "Payload Too Large";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            case 504: return "Gateway Timeout";
+            default: return "Unknown";
+        }
+    }
+
+    std::string url_decode(const std::string& value) {
+        std::string decoded;
+        for (size_t i = 0; i < value.size(); i++) {
+            if (value[i] == '+') {
+                decoded.push_back(' ');
+            }
+            else if (value[i] == '%' && i + 2 < value.size() && std::isxdigit(static_cast<unsigned char>(value[i + 1])) && std::isxdigit(static_cast<unsigned char>(value[i + 2]))) {
+                decoded.push_back(static_cast<char>(std::stoi(value.substr(i + 1, 2), nullptr, 16)));
+                i += 2;
+            }
+            else {
+                decoded.push_back(value[i]);
+            }
+        }
+        return decoded;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef BABYLON_SERVER_HTTP_H
+#define BABYLON_SERVER_HTTP_H
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Just enough HTTP/1.1 for the server and the load generator, one request per connection.
+namespace Http {
+  struct Request {
+    std::string method;
+    std::string path;
+    std::unordered_map<std::string, std::string> query;
+    std::unordered_map<std::string, std::string> headers; // names are lowercase
+    std::string body;
+  };
+
+  struct Response {
+    int status = 0;
+    std::unordered_map<std::string, std::string> headers; // names are lowercase
+  };
+
+  // Thrown when the peer sends nothing before the read deadline.
+  struct Timeout : std::runtime_error {
+    using std::runtime_error::runtime_error;
+  };
+
+  // Owns a connected socket, errors and disconnects are thrown as std::runtime_error.
+  class Connection {
+    public:
+      Connection(int fd);
+      ~Connection();
+
+      Connection(const Connection&) = delete;
+      Connection& operator=(const Connection&) = delete;
+
+      // Reads throw Timeout once the deadline passed, a client trickling bytes cannot hold the connection.
+      void set_read_deadline(std::chrono::steady_clock::time_point deadline);
+
+      // Returns false if the peer closed the connection before sending anything.
+      bool read_request(Request& request, size_t max_body);
+      Response read_response_head();
+
+      std::string read_line();
+      std::string read_exact(size_t size);
+      // Returns an empty string after the last chunk.
+      std::string read_chunk();
+
+      void send(const char* data, size_t size);
+      void send(const std::string& data);
+
+      void send_response(int status, const std::string& content_type, const std::string& body);
+      void begin_chunked(int status, const std::string& content_type);
+      void send_chunk(const char* data, size_t size);
+      void end_chunked();
+
+    private:
+      int fd;
+      std::string buffer;
+      size_t buffer_start;
+      bool has_read_deadline;
+      std::chrono::steady_clock::time_point read_deadline;
+
+      bool fill();
+      void read_headers(std::unordered_map<std::string, std::string>& headers);
+  };
+
+  int listen_on(const std::string& host, int port, int backlog);
+  int connect_to(const std::string& host, int port);
+
+  std::string status_text(int status);
+  std::string url_decode(const std::string& value);
+}
+
+#endif // BABYLON_SERVER_HTTP_H
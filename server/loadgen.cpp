@@ -0,0 +1,220 @@
+#include "http.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Load generator for babylon_server: keeps a fixed number of requests in flight and reports
+// throughput, time to first audio and latency percentiles.
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string endpoint = "tts";
+    size_t concurrency = 4;
+    size_t requests = 100;
+    std::vector<std::string> texts;
+};
+
+struct Sample {
+    bool ok;
+    double first_byte;
+    double total;
+    double audio_seconds;
+};
+
+static const std::vector<std::string> DEFAULT_TEXTS = {
+    "The quick brown fox jumps over the lazy dog.",
+    "Dr. Smith paid 1250 dollars for 3 tickets on Friday, then went home.",
+    "How much wood would a woodchuck chuck if a woodchuck could chuck wood? Nobody knows.",
+    "In 1969 two astronauts walked on the moon while millions watched.",
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static uint32_t read_le(const std::string& data, size_t offset, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[offset + i])) << (8 * i);
+    }
+    return value;
+}
+
+static Sample send_request(const Options& options, const std::string& text) {
+    Sample sample = {false, 0.0, 0.0, 0.0};
+    auto start = std::chrono::steady_clock::now();
+
+    Http::Connection connection(Http::connect_to(options.host, options.port));
+    connection.send("POST /" + options.endpoint + " HTTP/1.1\r\n"
+                    "Host: " + options.host + "\r\n"
+                    "Content-Type: text/plain; charset=utf-8\r\n"
+                    "Content-Length: " + std::to_string(text.size()) + "\r\n"
+                    "Connection: close\r\n\r\n" + text);
+
+    Http::Response response = connection.read_response_head();
+    sample.first_byte = seconds_since(start);
+
+    auto encoding = response.headers.find("transfer-encoding");
+    if (encoding != response.headers.end() && encoding->second == "chunked") {
+        // The WAV header carries the format, everything after it is PCM
+        std::string header;
+        uint64_t audio_bytes = 0;
+        bool first = true;
+
+        for (std::string chunk = connection.read_chunk(); !chunk.empty(); chunk = connection.read_chunk()) {
+            if (first) {
+                sample.first_byte = seconds_since(start);
+                first = false;
+            }
+
+            if (header.size() < 44) {
+                size_t take = std::min(chunk.size(), 44 - header.size());
+                header.append(chunk, 0, take);
+                audio_bytes += chunk.size() - take;
+            }
+            else {
+                audio_bytes += chunk.size();
+            }
+        }
+
+        if (header.size() == 44) {
+            uint32_t sample_rate = read_le(header, 24, 4);
+            uint32_t block_align = read_le(header, 32, 2);
+            sample.audio_seconds = static_cast<double>(audio_bytes) / block_align / sample_rate;
+        }
+    }
+    else {
+        auto length = response.headers.find("content-length");
+        if (length != response.headers.end()) {
+            connection.read_exact(std::stoul(length->second));
+        }
+    }
+
+    sample.total = seconds_since(start);
+    sample.ok = response.status == 200;
+    return sample;
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    std::sort(values.begin(), values.end());
+    size_t index = std::min(values.size() - 1, static_cast<size_t>(p / 100.0 * values.size()));
+    return values[index];
+}
+
+static void usage() {
+    std::cerr << "Usage: babylon_loadgen [options] [text ...]\n"
+              << "  --host <address>      default 127.0.0.1\n"
+              << "  --port <port>         default 8080\n"
+              << "  --endpoint tts|g2p    default tts\n"
+              << "  --concurrency <n>     requests in flight, default 4\n"
+              << "  --requests <n>        total requests, default 100\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--host") options.host = value();
+            else if (arg == "--port") options.port = std::stoi(value());
+            else if (arg == "--endpoint") options.endpoint = value();
+            else if (arg == "--concurrency") options.concurrency = std::stoul(value());
+            else if (arg == "--requests") options.requests = std::stoul(value());
+            else if (arg.rfind("--", 0) == 0) throw std::invalid_argument("Unknown option " + arg);
+            else options.texts.push_back(arg);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    if (options.texts.empty()) {
+        options.texts = DEFAULT_TEXTS;
+    }
+
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    std::vector<Sample> samples;
+    size_t errors = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> clients;
+    for (size_t c = 0; c < std::max<size_t>(options.concurrency, 1); c++) {
+        clients.emplace_back([&] {
+            for (size_t i = next++; i < options.requests; i = next++) {
+                try {
+                    Sample sample = send_request(options, options.texts[i % options.texts.size()]);
+                    std::lock_guard<std::mutex> lock(mutex);
+                    samples.push_back(sample);
+                }
+                catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (errors++ == 0) {
+                        std::cerr << e.what() << std::endl;
+                    }
+                }
+            }
+        });
+    }
+
+    for (auto& client : clients) {
+        client.join();
+    }
+
+    double elapsed = seconds_since(start);
+
+    std::vector<double> first_byte;
+    std::vector<double> total;
+    double audio_seconds = 0.0;
+    size_t failed = errors;
+
+    for (const auto& sample : samples) {
+        if (!sample.ok) {
+            failed++;
+            continue;
+        }
+        first_byte.push_back(sample.first_byte);
+        total.push_back(sample.total);
+        audio_seconds += sample.audio_seconds;
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << options.requests << " requests to /" << options.endpoint << ", " << options.concurrency << " in flight, " << failed << " failed\n";
+    std::cout << "throughput      " << total.size() / elapsed << " req/s";
+    if (audio_seconds > 0.0) {
+        std::cout << ", " << audio_seconds / elapsed << " audio s/s";
+    }
+    std::cout << "\n";
+
+    for (auto& [name, values] : {std::make_pair("first byte", &first_byte), std::make_pair("latency   ", &total)}) {
+        std::cout << name << " ms  p50 " << percentile(*values, 50) * 1000
+                  << "  p95 " << percentile(*values, 95) * 1000
+                  << "  p99 " << percentile(*values, 99) * 1000
+                  << "  max " << percentile(*values, 100) * 1000 << "\n";
+    }
+
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,152 @@
+#include "metrics.h"
+#include <sstream>
+
+// Request latencies in seconds, from a few milliseconds of G2P up to long synthesis
+static const std::vector<double> LATENCY_BOUNDS = {0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, 30};
+static const std::vector<double> BATCH_BOUNDS = {1, 2, 4, 8, 16, 32, 64};
+
+static std::string format(double value) {
+    std::ostringstream out;
+    out << value;
+    return out.str();
+}
+
+namespace Metrics {
+    Histogram::Histogram(std::vector<double> bounds) : bounds(std::move(bounds)), counts(this->bounds.size() + 1, 0), sum(0.0) {}
+
+    void Histogram::observe(double value) {
+        size_t i = 0;
+        while (i < bounds.size() && value > bounds[i]) {
+            i++;
+        }
+
+        counts[i]++;
+        sum += value;
+    }
+
+    void Histogram::render(std::string& out, const std::string& name, const std::string& labels) const {
+        std::string prefix = labels.empty() ? "" : labels + ",";
+
+        // Buckets are cumulative in the exposition format
+        uint64_t total = 0;
+        for (size_t i = 0; i < bounds.size(); i++) {
+            total += counts[i];
+            out += name + "_bucket{" + prefix + "le=\"" + format(bounds[i]) + "\"} " + std::to_string(total) + "\n";
+        }
+        total += counts.back();
+        out += name + "_bucket{" + prefix + "le=\"+Inf\"} " + std::to_string(total) + "\n";
+
+        std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+        out += name + "_sum" + suffix + " " + format(sum) + "\n";
+        out += name + "_count" + suffix + " " + std::to_string(total) + "\n";
+    }
+
+    Registry::Registry()
+        : first_chunk_seconds(LATENCY_BOUNDS), batch_sizes(BATCH_BOUNDS), batch_seconds(LATENCY_BOUNDS), audio_seconds(0.0), in_flight(0), queue_depth(0),
+          lexicon_lookups(0), lexicon_hits(0), lexicon_reloads(0), lexicon_entries(0), skipped_words(0) {}
+
+    void Registry::request_started() {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight++;
+    }
+
+    void Registry::request_finished(const std::string& endpoint, int status, double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        in_flight--;
+        requests[{endpoint, status}]++;
+        durations.try_emplace(endpoint, LATENCY_BOUNDS).first->second.observe(seconds);
+    }
+
+    void Registry::first_chunk(double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        first_chunk_seconds.observe(seconds);
+    }
+
+    void Registry::audio_produced(double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        audio_seconds += seconds;
+    }
+
+    void Registry::batch_run(size_t texts, double seconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch_sizes.observe(static_cast<double>(texts));
+        batch_seconds.observe(seconds);
+    }
+
+    void Registry::set_queue_depth(size_t depth) {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue_depth = depth;
+    }
+
+    void Registry::set_lexicon(uint64_t lookups, uint64_t hits, uint64_t reloads, size_t entries, uint64_t skipped) {
+        std::lock_guard<std::mutex> lock(mutex);
+        lexicon_lookups = lookups;
+        lexicon_hits = hits;
+        lexicon_reloads = reloads;
+        lexicon_entries = entries;
+        skipped_words = skipped;
+    }
+
+    std::string Registry::render() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::string out;
+
+        out += "# HELP babylon_requests_total Requests handled, by endpoint and status code.\n";
+        out += "# TYPE babylon_requests_total counter\n";
+        for (const auto& [key, count] : requests) {
+            out += "babylon_requests_total{endpoint=\"" + key.first + "\",code=\"" + std::to_string(key.second) + "\"} " + std::to_string(count) + "\n";
+        }
+
+        out += "# HELP babylon_request_duration_seconds Time from reading a request to sending its last byte.\n";
+        out += "# TYPE babylon_request_duration_seconds histogram\n";
+        for (const auto& [endpoint, histogram] : durations) {
+            histogram.render(out, "babylon_request_duration_seconds", "endpoint=\"" + endpoint + "\"");
+        }
+
+        out += "# HELP babylon_tts_first_chunk_seconds Time from reading a TTS request to sending its first audio.\n";
+        out += "# TYPE babylon_tts_first_chunk_seconds histogram\n";
+        first_chunk_seconds.render(out, "babylon_tts_first_chunk_seconds", "");
+
+        out += "# HELP babylon_audio_seconds_total Seconds of audio streamed to clients.\n";
+        out += "# TYPE babylon_audio_seconds_total counter\n";
+        out += "babylon_audio_seconds_total " + format(audio_seconds) + "\n";
+
+        out += "# HELP babylon_g2p_batch_size Texts per batched G2P run.\n";
+        out += "# TYPE babylon_g2p_batch_size histogram\n";
+        batch_sizes.render(out, "babylon_g2p_batch_size", "");
+
+        out += "# HELP babylon_g2p_batch_duration_seconds Time per batched G2P run.\n";
+        out += "# TYPE babylon_g2p_batch_duration_seconds histogram\n";
+        batch_seconds.render(out, "babylon_g2p_batch_duration_seconds", "");
+
+        out += "# HELP babylon_requests_in_flight Requests currently being handled.\n";
+        out += "# TYPE babylon_requests_in_flight gauge\n";
+        out += "babylon_requests_in_flight " + std::to_string(in_flight) + "\n";
+
+        out += "# HELP babylon_queue_depth Connections waiting for a worker.\n";
+        out += "# TYPE babylon_queue_depth gauge\n";
+        out += "babylon_queue_depth " + std::to_string(queue_depth) + "\n";
+
+        out += "# HELP babylon_lexicon_lookups_total Words looked up in the pronunciation overrides.\n";
+        out += "# TYPE babylon_lexicon_lookups_total counter\n";
+        out += "babylon_lexicon_lookups_total " + std::to_string(lexicon_lookups) + "\n";
+
+        out += "# HELP babylon_lexicon_hits_total Words resolved by the pronunciation overrides.\n";
+        out += "# TYPE babylon_lexicon_hits_total counter\n";
+        out += "babylon_lexicon_hits_total " + std::to_string(lexicon_hits) + "\n";
+
+        out += "# HELP babylon_lexicon_reloads_total Lexicon files loaded.\n";
+        out += "# TYPE babylon_lexicon_reloads_total counter\n";
+        out += "babylon_lexicon_reloads_total " + std::to_string(lexicon_reloads) + "\n";
+
+        out += "# HELP babylon_lexicon_entries Pronunciation overrides currently loaded.\n";
+        out += "# TYPE babylon_lexicon_entries gauge\n";
+        out += "babylon_lexicon_entries " + std::to_string(lexicon_entries) + "\n";
+
+        out += "# HELP babylon_g2p_skipped_words_total Words skipped in dictionary only mode.\n";
+        out += "# TYPE babylon_g2p_skipped_words_total counter\n";
+        out += "babylon_g2p_skipped_words_total " + std::to_string(skipped_words) + "\n";
+
+        return out;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef BABYLON_SERVER_METRICS_H
+#define BABYLON_SERVER_METRICS_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Prometheus text exposition of the server's counters, gauges and histograms.
+namespace Metrics {
+  class Histogram {
+    public:
+      Histogram(std::vector<double> bounds);
+
+      void observe(double value);
+      void render(std::string& out, const std::string& name, const std::string& labels) const;
+
+    private:
+      std::vector<double> bounds;
+      std::vector<uint64_t> counts; // one per bound plus +Inf
+      double sum;
+  };
+
+  class Registry {
+    public:
+      Registry();
+
+      void request_started();
+      void request_finished(const std::string& endpoint, int status, double seconds);
+      void first_chunk(double seconds);
+      void audio_produced(double seconds);
+      void batch_run(size_t texts, double seconds);
+      void set_queue_depth(size_t depth);
+      void set_lexicon(uint64_t lookups, uint64_t hits, uint64_t reloads, size_t entries, uint64_t skipped_words);
+
+      std::string render() const;
+
+    private:
+      mutable std::mutex mutex;
+      std::map<std::pair<std::string, int>, uint64_t> requests;
+      std::map<std::string, Histogram> durations;
+      Histogram first_chunk_seconds;
+      Histogram batch_sizes;
+      Histogram batch_seconds;
+      double audio_seconds;
+      int64_t in_flight;
+      size_t queue_depth;
+      uint64_t lexicon_lookups;
+      uint64_t lexicon_hits;
+      uint64_t lexicon_reloads;
+      size_t lexicon_entries;
+      uint64_t skipped_words;
+  };
+}
+
+#endif // BABYLON_SERVER_METRICS_H
@@ -0,0 +1,522 @@
+#include "babylon.h"
+#include "http.h"
+#include "metrics.h"
+#include <csignal>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Local TTS server keeping one DeepPhonemizer and one VITS session warm for all requests.
+//
+//   POST /tts?language=en_us&format=wav|raw   text body, PCM16 streamed as chunked audio while it is synthesized
+//   POST /g2p?language=en_us                  text body, phonemes as text/plain
+//   GET  /metrics                             Prometheus metrics
+//   GET  /health
+
+struct Options {
+    std::string g2p_model;
+    std::string tts_model;
+    std::string language = "en_us";
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    size_t threads = 0;
+    size_t max_queue = 256;
+    size_t max_batch = 32;
+    int batch_window_ms = 5;
+    size_t segment_parallelism = 1;
+    unsigned int timeout_ms = 0;
+    size_t max_body = 1 << 20;
+    unsigned int read_timeout_ms = 10000;
+    bool shared_weights = false;
+    bool lazy_load = false;
+    unsigned int idle_timeout_ms = 0;
+    std::string lexicon;
+    bool dictionary_only = false;
+    Babylon::ThreadingOptions threading;
+};
+
+// Audio is flushed to the client in chunks of this many bytes
+const size_t STREAM_CHUNK_SIZE = 8192;
+
+static volatile std::sig_atomic_t shutdown_requested = 0;
+static volatile std::sig_atomic_t reload_requested = 0;
+
+static void on_signal(int) {
+    shutdown_requested = 1;
+}
+
+static void on_reload(int) {
+    reload_requested = 1;
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Collects the segments of concurrent requests for a short window and phonemizes them in one
+// g2p_batch call, so words missing from the dictionaries share model runs across requests.
+class G2PBatcher {
+    public:
+        G2PBatcher(DeepPhonemizer::Session& dp, std::chrono::milliseconds window, size_t max_batch, Metrics::Registry& metrics)
+            : dp(dp), window(window), max_batch(max_batch), metrics(metrics), stopping(false), pending_texts(0) {
+            worker = std::thread(&G2PBatcher::work, this);
+        }
+
+        ~G2PBatcher() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            worker.join();
+        }
+
+        std::vector<std::vector<std::string>> submit(std::vector<std::string> texts, const std::string& language) {
+            if (texts.empty()) {
+                return {};
+            }
+
+            auto request = std::make_shared<Request>();
+            request->texts = std::move(texts);
+            request->language = language;
+            std::future<std::vector<std::vector<std::string>>> result = request->result.get_future();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending_texts += request->texts.size();
+                pending.push_back(request);
+            }
+            condition.notify_all();
+
+            return result.get();
+        }
+
+    private:
+        struct Request {
+            std::vector<std::string> texts;
+            std::string language;
+            std::promise<std::vector<std::vector<std::string>>> result;
+        };
+
+        DeepPhonemizer::Session& dp;
+        std::chrono::milliseconds window;
+        size_t max_batch;
+        Metrics::Registry& metrics;
+
+        std::thread worker;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+        std::deque<std::shared_ptr<Request>> pending;
+        size_t pending_texts;
+
+        void work() {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while (true) {
+                condition.wait(lock, [this] { return stopping || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+
+                // The first request waits at most one window for others to join it
+                condition.wait_for(lock, window, [this] { return stopping || pending_texts >= max_batch; });
+
+                std::vector<std::shared_ptr<Request>> batch;
+                size_t texts = 0;
+                while (!pending.empty() && (batch.empty() || texts + pending.front()->texts.size() <= max_batch)) {
+                    texts += pending.front()->texts.size();
+                    batch.push_back(pending.front());
+                    pending.pop_front();
+                }
+                pending_texts -= texts;
+
+                lock.unlock();
+                run(batch, texts);
+                lock.lock();
+            }
+        }
+
+        void run(const std::vector<std::shared_ptr<Request>>& batch, size_t count) {
+            std::vector<std::string> texts;
+            std::vector<std::string> languages;
+            texts.reserve(count);
+            languages.reserve(count);
+
+            for (const auto& request : batch) {
+                texts.insert(texts.end(), request->texts.begin(), request->texts.end());
+                languages.insert(languages.end(), request->texts.size(), request->language);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+
+            try {
+                std::vector<std::vector<std::string>> phonemes = dp.g2p_batch(texts, languages);
+                metrics.batch_run(count, seconds_since(start));
+
+                auto next = phonemes.begin();
+                for (const auto& request : batch) {
+                    auto end = next + request->texts.size();
+                    request->result.set_value(std::vector<std::vector<std::string>>(std::make_move_iterator(next), std::make_move_iterator(end)));
+                    next = end;
+                }
+            }
+            catch (...) {
+                for (const auto& request : batch) {
+                    request->result.set_exception(std::current_exception());
+                }
+            }
+        }
+};
+
+class Server {
+    public:
+        Server(const Options& options)
+            : options(options) {
+            Babylon::configure_threading(options.threading);
+
+            Babylon::ModelOptions model_options;
+            model_options.shared_weights = options.shared_weights;
+            model_options.lazy_load = options.lazy_load;
+            model_options.idle_timeout = std::chrono::milliseconds(options.idle_timeout_ms);
+
+            dp = std::make_unique<DeepPhonemizer::Session>(options.g2p_model, options.language, true, false, model_options);
+            dp->set_dictionary_only(options.dictionary_only);
+            if (!options.lexicon.empty()) {
+                dp->get_lexicon().load(options.lexicon, options.language);
+            }
+            vits = std::make_unique<Vits::Session>(options.tts_model, model_options);
+            batcher = std::make_unique<G2PBatcher>(*dp, std::chrono::milliseconds(options.batch_window_ms), options.max_batch, metrics);
+            pool = std::make_unique<Babylon::ThreadPool>(options.threads, Babylon::pin_request_threads());
+        }
+
+        ~Server() {
+            // Finish in-flight requests before the sessions they use go away
+            pool.reset();
+        }
+
+        void serve() {
+            int listener = Http::listen_on(options.host, options.port, 128);
+            std::cerr << "Listening on " << options.host << ":" << options.port << " with " << pool->size() << " workers, "
+                      << Babylon::intra_op_threads() << " ORT threads" << std::endl;
+
+            while (!shutdown_requested) {
+                if (reload_requested) {
+                    reload_requested = 0;
+                    reload_lexicon();
+                }
+
+                pollfd descriptor = {listener, POLLIN, 0};
+                if (poll(&descriptor, 1, 200) <= 0) {
+                    continue;
+                }
+
+                int fd = accept(listener, nullptr, nullptr);
+                if (fd < 0) {
+                    continue;
+                }
+
+                // Shed load up front rather than letting latency grow without bound
+                if (pool->queue_depth() >= options.max_queue) {
+                    Http::Connection connection(fd);
+                    respond(connection, "overload", 503, "Server busy.\n", std::chrono::steady_clock::now());
+                    continue;
+                }
+
+                pool->enqueue([this, fd] { handle(fd); });
+            }
+
+            close(listener);
+            std::cerr << "Shutting down" << std::endl;
+        }
+
+    private:
+        Options options;
+        Metrics::Registry metrics;
+        std::unique_ptr<DeepPhonemizer::Session> dp;
+        std::unique_ptr<Vits::Session> vits;
+        std::unique_ptr<G2PBatcher> batcher;
+        std::unique_ptr<Babylon::ThreadPool> pool;
+
+        // Requests keep being served from the old entries while the file is parsed, a broken file keeps them
+        void reload_lexicon() {
+            if (options.lexicon.empty()) {
+                return;
+            }
+
+            try {
+                dp->get_lexicon().load(options.lexicon, options.language);
+                std::cerr << "Reloaded lexicon " << options.lexicon << std::endl;
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+            }
+        }
+
+        void respond(Http::Connection& connection, const std::string& endpoint, int status, const std::string& body, std::chrono::steady_clock::time_point start, const std::string& content_type = "text/plain; charset=utf-8") {
+            metrics.request_started();
+            try {
+                connection.send_response(status, content_type, body);
+            }
+            catch (const std::exception&) {
+                // The client went away, it still counts as handled
+            }
+            metrics.request_finished(endpoint, status, seconds_since(start));
+        }
+
+        void handle(int fd) {
+            Http::Connection connection(fd);
+            Http::Request request;
+            auto start = std::chrono::steady_clock::now();
+
+            if (options.read_timeout_ms > 0) {
+                connection.set_read_deadline(start + std::chrono::milliseconds(options.read_timeout_ms));
+            }
+
+            try {
+                if (!connection.read_request(request, options.max_body)) {
+                    return;
+                }
+            }
+            catch (const std::length_error& e) {
+                respond(connection, "invalid", 413, std::string(e.what()) + "\n", start);
+                return;
+            }
+            catch (const Http::Timeout& e) {
+                respond(connection, "timeout", 408, std::string(e.what()) + "\n", start);
+                return;
+            }
+            catch (const std::exception& e) {
+                respond(connection, "invalid", 400, std::string(e.what()) + "\n", start);
+                return;
+            }
+
+            start = std::chrono::steady_clock::now();
+
+            if (request.path == "/tts" || request.path == "/g2p") {
+                if (request.method != "POST") {
+                    respond(connection, request.path.substr(1), 405, "Use POST.\n", start);
+                }
+                else if (request.path == "/tts") {
+                    tts(connection, request, start);
+                }
+                else {
+                    g2p(connection, request, start);
+                }
+            }
+            else if (request.path == "/metrics") {
+                metrics.set_queue_depth(pool->queue_depth());
+                DeepPhonemizer::Lexicon::Stats lexicon = dp->get_lexicon().get_stats();
+                metrics.set_lexicon(lexicon.lookups, lexicon.hits, lexicon.reloads, lexicon.entries, dp->get_skipped_words());
+                respond(connection, "metrics", 200, metrics.render(), start, "text/plain; version=0.0.4");
+            }
+            else if (request.path == "/health") {
+                respond(connection, "health", 200, "ok\n", start);
+            }
+            else {
+                respond(connection, "unknown", 404, "Not found.\n", start);
+            }
+        }
+
+        std::string language_of(const Http::Request& request) const {
+            auto language = request.query.find("language");
+            return language == request.query.end() ? dp->get_language() : language->second;
+        }
+
+        void g2p(Http::Connection& connection, const Http::Request& request, std::chrono::steady_clock::time_point start) {
+            try {
+                std::vector<std::vector<std::string>> phonemes = batcher->submit({request.body}, language_of(request));
+
+                std::string body;
+                for (const auto& phoneme : phonemes.empty() ? std::vector<std::string>() : phonemes.front()) {
+                    body += phoneme + " ";
+                }
+                respond(connection, "g2p", 200, body + "\n", start);
+            }
+            catch (const std::exception& e) {
+                respond(connection, "g2p", 500, std::string(e.what()) + "\n", start);
+            }
+        }
+
+        void tts(Http::Connection& connection, const Http::Request& request, std::chrono::steady_clock::time_point start) {
+            metrics.request_started();
+
+            auto format = request.query.find("format");
+            bool raw = format != request.query.end() && format->second == "raw";
+
+            Babylon::CancellationToken token;
+            if (options.timeout_ms > 0) {
+                token.set_deadline(start + std::chrono::milliseconds(options.timeout_ms));
+            }
+
+            int status = 200;
+            bool streaming = false;
+
+            try {
+                std::string language = language_of(request);
+                std::vector<DeepPhonemizer::Segment> segments = DeepPhonemizer::segment_text(request.body, language);
+
+                std::vector<std::string> texts;
+                std::vector<float> pauses;
+                for (const auto& segment : segments) {
+                    texts.push_back(segment.text);
+                    pauses.push_back(segment.pause);
+                }
+
+                std::vector<std::vector<std::string>> phonemes = batcher->submit(std::move(texts), language);
+                token.check();
+
+                // Headers only go out once G2P succeeded, so failures up to here still get a proper status
+                int sample_rate = vits->get_sample_rate();
+                connection.begin_chunked(200, raw ? "audio/L16; rate=" + std::to_string(sample_rate) + "; channels=1" : "audio/wav");
+                streaming = true;
+
+                bool first = true;
+                Babylon::AudioSink sink = [&](const char* data, size_t size) {
+                    if (first) {
+                        metrics.first_chunk(seconds_since(start));
+                        first = false;
+                    }
+
+                    try {
+                        connection.send_chunk(data, size);
+                    }
+                    catch (const std::exception&) {
+                        // Client disconnected, stop synthesizing for it
+                        token.cancel();
+                        throw Babylon::Cancelled(false);
+                    }
+                };
+
+                Babylon::AudioWriter writer(sink, sample_rate, Babylon::AudioFormat::PCM16, raw ? Babylon::AudioContainer::RAW : Babylon::AudioContainer::WAV, 1, STREAM_CHUNK_SIZE);
+                vits->tts(phonemes, pauses, writer, &token, options.segment_parallelism);
+                writer.close();
+                connection.end_chunked();
+
+                metrics.audio_produced(static_cast<double>(writer.samples_written()) / sample_rate);
+            }
+            catch (const Babylon::Cancelled& e) {
+                status = e.is_timeout() ? 504 : 499;
+            }
+            catch (const std::exception& e) {
+                status = 500;
+                if (!streaming) {
+                    try {
+                        connection.send_response(status, "text/plain; charset=utf-8", std::string(e.what()) + "\n");
+                    }
+                    catch (const std::exception&) {}
+                }
+            }
+
+            // Once streaming has started the status line is gone, an unterminated chunked body tells the client it failed
+            if (status == 504 && !streaming) {
+                try {
+                    connection.send_response(status, "text/plain; charset=utf-8", "Timed out.\n");
+                }
+                catch (const std::exception&) {}
+            }
+
+            metrics.request_finished("tts", status, seconds_since(start));
+        }
+};
+
+static Babylon::ThreadingMode parse_mode(const std::string& mode) {
+    if (mode == "throughput") {
+        return Babylon::ThreadingMode::THROUGHPUT;
+    }
+    if (mode == "latency") {
+        return Babylon::ThreadingMode::LATENCY;
+    }
+    throw std::invalid_argument("Unknown threading mode " + mode);
+}
+
+static void usage() {
+    std::cerr << "Usage: babylon_server --g2p <model> --tts <model> [options]\n"
+              << "  --language <language>       default language for requests, default en_us\n"
+              << "  --host <address>            default 127.0.0.1\n"
+              << "  --port <port>               default 8080\n"
+              << "  --threads <n>               request workers, default one per core\n"
+              << "  --max-queue <n>             connections waiting before 503, default 256\n"
+              << "  --batch-window-ms <ms>      time G2P waits for concurrent requests, default 5\n"
+              << "  --max-batch <n>             texts per batched G2P run, default 32\n"
+              << "  --segment-parallelism <n>   segments of one request synthesized at once, default 1\n"
+              << "  --timeout-ms <ms>           per request deadline, default none\n"
+              << "  --read-timeout-ms <ms>      time a client has to send its request before 408, 0 waits forever, default 10000\n"
+              << "  --shared-weights            map ORT format models read-only\n"
+              << "  --lazy-load                 load the models on the first request instead of at startup\n"
+              << "  --idle-timeout-ms <ms>      release models unused for this long, default never\n"
+              << "  --lexicon <file>            pronunciation overrides for the default language, reloaded on SIGHUP\n"
+              << "  --dictionary-only           skip words missing from the lexicon and dictionaries instead of running G2P\n"
+              << "  --mode throughput|latency   single threaded runs side by side, or each run on the whole pool, default latency\n"
+              << "  --ort-threads <n>           shared ORT pool size in latency mode, default one per core\n"
+              << "  --pin                       pin worker threads to cores\n"
+              << "  --numa-node <n>             pin worker threads to the cores of one NUMA node\n";
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    try {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::invalid_argument("Missing value for " + arg);
+                }
+                return argv[++i];
+            };
+
+            if (arg == "--g2p") options.g2p_model = value();
+            else if (arg == "--tts") options.tts_model = value();
+            else if (arg == "--language") options.language = value();
+            else if (arg == "--host") options.host = value();
+            else if (arg == "--port") options.port = std::stoi(value());
+            else if (arg == "--threads") options.threads = std::stoul(value());
+            else if (arg == "--max-queue") options.max_queue = std::stoul(value());
+            else if (arg == "--batch-window-ms") options.batch_window_ms = std::stoi(value());
+            else if (arg == "--max-batch") options.max_batch = std::stoul(value());
+            else if (arg == "--segment-parallelism") options.segment_parallelism = std::stoul(value());
+            else if (arg == "--timeout-ms") options.timeout_ms = std::stoul(value());
+            else if (arg == "--read-timeout-ms") options.read_timeout_ms = std::stoul(value());
+            else if (arg == "--shared-weights") options.shared_weights = true;
+            else if (arg == "--lazy-load") options.lazy_load = true;
+            else if (arg == "--idle-timeout-ms") options.idle_timeout_ms = std::stoul(value());
+            else if (arg == "--lexicon") options.lexicon = value();
+            else if (arg == "--dictionary-only") options.dictionary_only = true;
+            else if (arg == "--mode") options.threading.mode = parse_mode(value());
+            else if (arg == "--ort-threads") options.threading.threads = std::stoul(value());
+            else if (arg == "--pin") options.threading.pin_threads = true;
+            else if (arg == "--numa-node") options.threading.numa_node = std::stoi(value());
+            else throw std::invalid_argument("Unknown option " + arg);
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    if (options.g2p_model.empty() || options.tts_model.empty()) {
+        usage();
+        return 1;
+    }
+
+    std::signal(SIGPIPE, SIG_IGN);
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+    std::signal(SIGHUP, on_reload);
+
+    try {
+        Server server(options);
+        server.serve();
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
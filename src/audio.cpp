@@ -0,0 +1,231 @@
+#include "babylon.h"
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+struct WavHeader {
+  uint8_t RIFF[4] = {'R', 'I', 'F', 'F'};
+  uint32_t chunk_size;
+  uint8_t WAVE[4] = {'W', 'A', 'V', 'E'};
+
+  // fmt
+  uint8_t fmt[4] = {'f', 'm', 't', ' '};
+  uint32_t fmt_size = 16;       // bytes
+  uint16_t audio_format = 1;    // PCM
+  uint16_t num_channels;        // mono
+  uint32_t sample_rate;         // Hertz
+  uint32_t bytes_per_second;    // sample_rate * sample_width
+  uint16_t block_align = 2;     // 16-bit mono
+  uint16_t bits_per_sample = 16;
+
+  // data
+  uint8_t data[4] = {'d', 'a', 't', 'a'};
+  uint32_t data_size;
+};
+
+// Sizes written while the stream is still open, readers treat these as "until EOF"
+const uint32_t WAV_UNKNOWN_SIZE = std::numeric_limits<uint32_t>::max();
+
+namespace Babylon {
+    AudioWriter::AudioWriter(const std::string& output_path, int sample_rate, AudioFormat format, AudioContainer container, int channels, size_t chunk_size)
+        : sample_rate(sample_rate), channels(channels), format(format), container(container), file(nullptr), owns_file(false), buffer_used(0), data_size(0) {
+        start(chunk_size);
+
+        if (output_path == "-") {
+            file = stdout;
+#ifdef _WIN32
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        }
+        else {
+            file = std::fopen(output_path.c_str(), "wb");
+            owns_file = true;
+
+            if (file == nullptr) {
+                throw std::runtime_error("Failed to open output file: " + output_path);
+            }
+        }
+
+        // Chunks are assembled in our own buffer, so stdio buffering would only add a copy
+        std::setvbuf(file, nullptr, _IONBF, 0);
+        open = true;
+    }
+
+    AudioWriter::AudioWriter(AudioSink sink, int sample_rate, AudioFormat format, AudioContainer container, int channels, size_t chunk_size)
+        : sample_rate(sample_rate), channels(channels), format(format), container(container), file(nullptr), owns_file(false), sink(std::move(sink)), buffer_used(0), data_size(0) {
+        start(chunk_size);
+        open = true;
+    }
+
+    void AudioWriter::start(size_t chunk_size) {
+        if (channels < 1) {
+            throw std::invalid_argument("Channel count must be at least one.");
+        }
+
+        switch (format) {
+            case AudioFormat::PCM16:
+                sample_width = 2;
+                break;
+            case AudioFormat::PCM24:
+                sample_width = 3;
+                break;
+            case AudioFormat::FLOAT32:
+                sample_width = 4;
+                break;
+            default:
+                throw std::invalid_argument("Unsupported audio format.");
+        }
+
+        // Flush in whole frames so a chunk never ends halfway through a sample
+        size_t frame_size = sample_width * channels;
+        chunk_size = std::max(chunk_size, std::max<size_t>(sizeof(WavHeader), frame_size));
+        buffer.resize(chunk_size - chunk_size % frame_size);
+
+        // The header goes through the chunk buffer so every later flush starts on a chunk boundary
+        if (container == AudioContainer::WAV) {
+            encode_header(reinterpret_cast<uint8_t*>(buffer.data()), WAV_UNKNOWN_SIZE);
+            buffer_used = sizeof(WavHeader);
+        }
+    }
+
+    AudioWriter::~AudioWriter() {
+        try {
+            close();
+        }
+        catch (const std::exception&) {
+            // Destructors must not throw, call close() directly to observe write errors
+        }
+    }
+
+    void AudioWriter::write(const float* samples, size_t count, float gain) {
+        if (!open) {
+            throw std::runtime_error("Audio writer is closed.");
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            if (buffer.size() - buffer_used < sample_width) {
+                flush();
+            }
+
+            float value = samples[i] * gain;
+            uint8_t* out = reinterpret_cast<uint8_t*>(buffer.data()) + buffer_used;
+
+            switch (format) {
+                case AudioFormat::PCM16: {
+                    int16_t sample = static_cast<int16_t>(std::clamp(value * 32767.0f, -32768.0f, 32767.0f));
+                    out[0] = sample & 0xFF;
+                    out[1] = (sample >> 8) & 0xFF;
+                    break;
+                }
+                case AudioFormat::PCM24: {
+                    int32_t sample = static_cast<int32_t>(std::clamp(value * 8388607.0f, -8388608.0f, 8388607.0f));
+                    out[0] = sample & 0xFF;
+                    out[1] = (sample >> 8) & 0xFF;
+                    out[2] = (sample >> 16) & 0xFF;
+                    break;
+                }
+                case AudioFormat::FLOAT32:
+                    std::memcpy(out, &value, sizeof(float));
+                    break;
+            }
+
+            buffer_used += sample_width;
+        }
+
+        data_size += count * sample_width;
+    }
+
+    void AudioWriter::write_silence(size_t count) {
+        const float zeros[256] = {};
+
+        while (count > 0) {
+            size_t n = std::min(count, sizeof(zeros) / sizeof(float));
+            write(zeros, n);
+            count -= n;
+        }
+    }
+
+    void AudioWriter::flush() {
+        if (!open || buffer_used == 0) {
+            return;
+        }
+
+        // Empty the buffer first, when the write throws close() must not send the same chunk again
+        size_t used = buffer_used;
+        buffer_used = 0;
+
+        if (sink) {
+            sink(buffer.data(), used);
+        }
+        else if (std::fwrite(buffer.data(), 1, used, file) != used) {
+            throw std::runtime_error("Failed to write audio data.");
+        }
+    }
+
+    void AudioWriter::close() {
+        if (!open) {
+            return;
+        }
+
+        // Sinks are not seekable, a WAV sent to one keeps the open-ended header
+        if (sink) {
+            open = false;
+            size_t used = buffer_used;
+            buffer_used = 0;
+            if (used > 0) {
+                sink(buffer.data(), used);
+            }
+            return;
+        }
+
+        // Write out whatever is left before finalizing the header
+        bool written = buffer_used == 0 || std::fwrite(buffer.data(), 1, buffer_used, file) == buffer_used;
+        buffer_used = 0;
+
+        // Patch the real sizes in when the output is seekable and they fit, pipes keep the open-ended header
+        if (written && container == AudioContainer::WAV && data_size < WAV_UNKNOWN_SIZE - sizeof(WavHeader) && std::fseek(file, 0, SEEK_SET) == 0) {
+            uint8_t header[sizeof(WavHeader)];
+            encode_header(header, static_cast<uint32_t>(data_size));
+            written = std::fwrite(header, sizeof(header), 1, file) == 1;
+        }
+
+        std::fflush(file);
+        if (owns_file) {
+            std::fclose(file);
+        }
+        file = nullptr;
+        open = false;
+
+        if (!written) {
+            throw std::runtime_error("Failed to write audio data.");
+        }
+    }
+
+    uint64_t AudioWriter::samples_written() const {
+        return data_size / sample_width;
+    }
+
+    int AudioWriter::get_sample_rate() const {
+        return sample_rate;
+    }
+
+    void AudioWriter::encode_header(uint8_t* out, uint32_t data_size) const {
+        WavHeader header;
+        header.data_size = data_size;
+        header.chunk_size = data_size == WAV_UNKNOWN_SIZE ? WAV_UNKNOWN_SIZE : data_size + sizeof(WavHeader) - 8;
+        header.audio_format = format == AudioFormat::FLOAT32 ? 3 : 1; // IEEE float or PCM
+        header.num_channels = channels;
+        header.sample_rate = sample_rate;
+        header.bytes_per_second = sample_rate * sample_width * channels;
+        header.block_align = sample_width * channels;
+        header.bits_per_sample = sample_width * 8;
+        std::memcpy(out, &header, sizeof(header));
+    }
+}
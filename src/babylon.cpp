@@ -1,13 +1,230 @@
 #include "babylon.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
 
 static DeepPhonemizer::Session* dp;
 static Vits::Session* vits;
 
+// Set by babylon_configure_memory, applied to the sessions created afterwards
+static Babylon::ModelOptions memory_options;
+
+static std::unique_ptr<Babylon::ThreadPool> pool;
+static std::mutex pool_mutex;
+
+struct babylon_job {
+    std::atomic<int> references{2}; // caller and worker
+    Babylon::CancellationToken token;
+
+    std::string text;
+    std::string output_path;
+    std::string result;
+    babylon_job_callback_t callback;
+    void* user_data;
+
+    babylon_job_status_t status = BABYLON_JOB_PENDING;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+struct babylon_g2p_stream {
+    DeepPhonemizer::StreamingSession session;
+};
+
+static void release_job(babylon_job_t* job) {
+    if (job->references.fetch_sub(1) == 1) {
+        delete job;
+    }
+}
+
+static std::string join_phonemes(const std::vector<std::string>& phoneme_vec) {
+    std::string phonemes = "";
+    for (const auto& phoneme : phoneme_vec) {
+        phonemes += phoneme + " ";
+    }
+    return phonemes;
+}
+
+// Segments drive the pipeline: one batched G2P call for all of them, then synthesis streamed to the writer with pauses
+static void synthesize(const std::string& text, Babylon::AudioWriter& writer, Babylon::CancellationToken* token, size_t parallelism) {
+    std::vector<DeepPhonemizer::Segment> segments = DeepPhonemizer::segment_text(text, dp->get_language());
+
+    std::vector<std::string> texts;
+    std::vector<float> pauses;
+    for (const auto& segment : segments) {
+        texts.push_back(segment.text);
+        pauses.push_back(segment.pause);
+    }
+
+    std::vector<std::vector<std::string>> phonemes = dp->g2p_batch(texts, std::vector<std::string>(texts.size(), dp->get_language()), token);
+
+    vits->tts(phonemes, pauses, writer, token, parallelism);
+    writer.close();
+}
+
+static void synthesize(const std::string& text, const std::string& output_path, Babylon::CancellationToken* token, size_t parallelism) {
+    Babylon::AudioWriter writer(output_path, vits->get_sample_rate());
+    synthesize(text, writer, token, parallelism);
+}
+
+// Float chunks small enough that streaming callers hear audio early
+const size_t STREAM_CHUNK_SIZE = 4096 * sizeof(float);
+
+static void finish_job(babylon_job_t* job, babylon_job_status_t status) {
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->status = status;
+    }
+    job->condition.notify_all();
+
+    if (job->callback != nullptr) {
+        job->callback(job, status, job->user_data);
+    }
+
+    release_job(job);
+}
+
+static void run_job(babylon_job_t* job, bool tts) {
+    try {
+        job->token.check();
+
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            job->status = BABYLON_JOB_RUNNING;
+        }
+
+        // The pool already runs as many jobs as the threading mode allows, so segments of one job are not synthesized in parallel
+        if (tts) {
+            synthesize(job->text, job->output_path, &job->token, 1);
+        }
+        else {
+            job->result = join_phonemes(dp->g2p(job->text, &job->token));
+        }
+    }
+    catch (const Babylon::Cancelled& e) {
+        finish_job(job, e.is_timeout() ? BABYLON_JOB_TIMED_OUT : BABYLON_JOB_CANCELLED);
+        return;
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        finish_job(job, BABYLON_JOB_FAILED);
+        return;
+    }
+
+    finish_job(job, BABYLON_JOB_DONE);
+}
+
+static babylon_job_t* submit_job(const char* text, const char* output_path, babylon_job_callback_t callback, void* user_data, unsigned int timeout_ms) {
+    if (text == nullptr) {
+        std::cerr << "Text must not be null." << std::endl;
+        return nullptr;
+    }
+
+    babylon_job_t* job = new babylon_job;
+    job->text = text;
+    job->output_path = output_path == nullptr ? "" : output_path;
+    job->callback = callback;
+    job->user_data = user_data;
+    if (timeout_ms > 0) {
+        job->token.set_deadline(std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms));
+    }
+
+    bool tts = output_path != nullptr;
+
+    try {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+
+        // Checked again under the lock, a free running meanwhile has shut the pool down and deleted the session
+        if (dp == nullptr || (tts && vits == nullptr)) {
+            throw std::runtime_error("Session freed while submitting the job.");
+        }
+
+        if (pool == nullptr) {
+            pool = std::make_unique<Babylon::ThreadPool>(Babylon::request_parallelism(), Babylon::pin_request_threads());
+        }
+        pool->enqueue([job, tts] { run_job(job, tts); });
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        delete job;
+        return nullptr;
+    }
+
+    return job;
+}
+
+// Waits for queued and running jobs so no worker touches the session while it is freed. The lock is
+// held until the session is gone, so a concurrent submit cannot start a new pool for it.
+template <typename Session>
+static void free_session(Session*& session) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    pool.reset();
+    delete session;
+    session = nullptr;
+}
+
 extern "C" {
+    BABYLON_EXPORT int babylon_configure_threading(babylon_threading_options_t options) {
+        try {
+            Babylon::ThreadingOptions threading;
+            threading.mode = options.mode == BABYLON_THREADING_THROUGHPUT ? Babylon::ThreadingMode::THROUGHPUT : Babylon::ThreadingMode::LATENCY;
+            threading.threads = options.threads;
+            threading.pin_threads = options.pin_threads;
+            threading.numa_node = options.numa_node;
+
+            Babylon::configure_threading(threading);
+            return 0;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    BABYLON_EXPORT int babylon_configure_memory(babylon_memory_options_t options) {
+        memory_options.lazy_load = options.lazy_load;
+        memory_options.idle_timeout = std::chrono::milliseconds(options.idle_timeout_ms);
+        return 0;
+    }
+
+    BABYLON_EXPORT babylon_memory_usage_t babylon_memory_usage(void) {
+        babylon_memory_usage_t usage = {};
+
+        if (dp != nullptr) {
+            usage.g2p_model = dp->get_model_bytes();
+            usage.g2p_dictionaries = dp->get_dictionary_bytes();
+        }
+
+        if (vits != nullptr) {
+            usage.tts_model = vits->get_model_bytes();
+            usage.tts_cache = vits->get_cache_bytes();
+        }
+
+        usage.process = Babylon::resident_bytes();
+        return usage;
+    }
+
+    BABYLON_EXPORT void babylon_unload(void) {
+        if (dp != nullptr) {
+            dp->unload();
+        }
+
+        if (vits != nullptr) {
+            vits->unload();
+        }
+    }
+
     BABYLON_EXPORT int babylon_g2p_init(const char* model_path, babylon_g2p_options_t options) {
         try {
-            dp = new DeepPhonemizer::Session(model_path, options.language, options.use_dictionaries, options.use_punctuation);
+            Babylon::ModelOptions model_options = memory_options;
+            model_options.shared_weights = options.use_shared_weights;
+
+            dp = new DeepPhonemizer::Session(model_path, options.language, options.use_dictionaries, options.use_punctuation, model_options);
             return 0;
         } 
         catch (const std::exception& e) {
@@ -17,17 +234,23 @@ extern "C" {
     }
 
     BABYLON_EXPORT char* babylon_g2p(const char* text) {
+        return babylon_g2p_with_language(text, nullptr);
+    }
+
+    BABYLON_EXPORT char* babylon_g2p_with_language(const char* text, const char* language) {
         if (dp == nullptr) {
             std::cerr << "DeepPhonemizer session not initialized." << std::endl;
             return nullptr;
         }
 
+        if (text == nullptr) {
+            std::cerr << "Text must not be null." << std::endl;
+            return nullptr;
+        }
+
         std::string phonemes = "";
         try {
-            std::vector<std::string> phoneme_vec = dp->g2p(text);
-            for (const auto& phoneme : phoneme_vec) {
-                phonemes += phoneme + " ";
-            }
+            phonemes = join_phonemes(language == nullptr ? dp->g2p(text) : dp->g2p(text, language));
         } 
         catch (const std::exception& e) {
             std::cerr << e.what() << std::endl;
@@ -37,14 +260,23 @@ extern "C" {
     }
 
     BABYLON_EXPORT int* babylon_g2p_tokens(const char* text) {
+        return babylon_g2p_tokens_with_language(text, nullptr);
+    }
+
+    BABYLON_EXPORT int* babylon_g2p_tokens_with_language(const char* text, const char* language) {
         if (dp == nullptr) {
             std::cerr << "DeepPhonemizer session not initialized." << std::endl;
             return nullptr;
         }
 
+        if (text == nullptr) {
+            std::cerr << "Text must not be null." << std::endl;
+            return nullptr;
+        }
+
         std::vector<int64_t> phoneme_ids;
         try {
-            phoneme_ids = dp->g2p_tokens(text);
+            phoneme_ids = language == nullptr ? dp->g2p_tokens(text) : dp->g2p_tokens(text, language);
         } 
         catch (const std::exception& e) {
             std::cerr << e.what() << std::endl;
@@ -52,7 +284,11 @@ extern "C" {
 
         phoneme_ids.push_back(-1); // Sentinel value
 
-        int* phoneme_ids_arr = new int[phoneme_ids.size()];
+        int* phoneme_ids_arr = static_cast<int*>(std::malloc(phoneme_ids.size() * sizeof(int)));
+        if (phoneme_ids_arr == nullptr) {
+            return nullptr;
+        }
+
         for (size_t i = 0; i < phoneme_ids.size(); i++) {
             phoneme_ids_arr[i] = phoneme_ids[i];
         }
@@ -60,13 +296,190 @@ extern "C" {
         return phoneme_ids_arr;
     }
 
+    BABYLON_EXPORT char** babylon_g2p_batch(const char** texts, const char** languages, size_t count) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        if (texts == nullptr || std::any_of(texts, texts + count, [](const char* text) { return text == nullptr; })) {
+            std::cerr << "Texts must not be null." << std::endl;
+            return nullptr;
+        }
+
+        std::vector<std::vector<std::string>> phonemes;
+        try {
+            std::vector<std::string> text_vec(texts, texts + count);
+            std::vector<std::string> language_vec;
+            for (size_t i = 0; i < count; i++) {
+                language_vec.push_back(languages == nullptr || languages[i] == nullptr ? dp->get_language() : languages[i]);
+            }
+
+            phonemes = dp->g2p_batch(text_vec, language_vec);
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+
+        char** results = static_cast<char**>(std::calloc(count, sizeof(char*)));
+        if (results == nullptr) {
+            return nullptr;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            results[i] = strdup(join_phonemes(phonemes[i]).c_str());
+        }
+
+        return results;
+    }
+
+    BABYLON_EXPORT void babylon_g2p_batch_free(char** results, size_t count) {
+        if (results == nullptr) {
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            std::free(results[i]);
+        }
+        std::free(results);
+    }
+
+    BABYLON_EXPORT babylon_g2p_stream_t* babylon_g2p_stream_create(const char* language) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        try {
+            return new babylon_g2p_stream{DeepPhonemizer::StreamingSession(*dp, language == nullptr ? "" : language)};
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+    }
+
+    BABYLON_EXPORT char* babylon_g2p_stream_push(babylon_g2p_stream_t* stream, const char* fragment) {
+        if (fragment == nullptr) {
+            std::cerr << "Fragment must not be null." << std::endl;
+            return nullptr;
+        }
+
+        std::string phonemes = "";
+        try {
+            phonemes = join_phonemes(stream->session.push(fragment));
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+
+        return strdup(phonemes.c_str());
+    }
+
+    BABYLON_EXPORT char* babylon_g2p_stream_finish(babylon_g2p_stream_t* stream) {
+        std::string phonemes = "";
+        try {
+            phonemes = join_phonemes(stream->session.finish());
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return nullptr;
+        }
+
+        return strdup(phonemes.c_str());
+    }
+
+    BABYLON_EXPORT void babylon_g2p_stream_free(babylon_g2p_stream_t* stream) {
+        delete stream;
+    }
+
+    BABYLON_EXPORT size_t babylon_tokens_length(const int* tokens) {
+        size_t length = 0;
+        while (tokens != nullptr && tokens[length] != -1) {
+            length++;
+        }
+        return length;
+    }
+
+    BABYLON_EXPORT int babylon_g2p_lexicon_load(const char* path, const char* language) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return 1;
+        }
+
+        if (path == nullptr) {
+            std::cerr << "Lexicon path must not be null." << std::endl;
+            return 1;
+        }
+
+        try {
+            dp->get_lexicon().load(path, language == nullptr ? dp->get_language() : language);
+            return 0;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    BABYLON_EXPORT int babylon_g2p_lexicon_set(const char* word, const char* phonemes, const char* language) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return 1;
+        }
+
+        if (word == nullptr || phonemes == nullptr) {
+            std::cerr << "Word and phonemes must not be null." << std::endl;
+            return 1;
+        }
+
+        try {
+            std::vector<std::string> phoneme_vec;
+            std::stringstream phoneme_stream(phonemes);
+            std::string phoneme;
+            while (phoneme_stream >> phoneme) {
+                phoneme_vec.push_back(phoneme);
+            }
+
+            dp->get_lexicon().set(word, phoneme_vec, language == nullptr ? dp->get_language() : language);
+            return 0;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    BABYLON_EXPORT int babylon_g2p_set_dictionary_only(int enabled) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return 1;
+        }
+
+        dp->set_dictionary_only(enabled != 0);
+        return 0;
+    }
+
+    BABYLON_EXPORT void babylon_free(void* ptr) {
+        std::free(ptr);
+    }
+
     BABYLON_EXPORT void babylon_g2p_free(void) {
-        delete dp;
+        free_session(dp);
     }
 
     BABYLON_EXPORT int babylon_tts_init(const char* model_path) {
+        return babylon_tts_init_with_options(model_path, babylon_tts_options_t{0});
+    }
+
+    BABYLON_EXPORT int babylon_tts_init_with_options(const char* model_path, babylon_tts_options_t options) {
         try {
-            vits = new Vits::Session(model_path);
+            Babylon::ModelOptions model_options = memory_options;
+            model_options.shared_weights = options.use_shared_weights;
+
+            vits = new Vits::Session(model_path, model_options);
             return 0;
         } 
         catch (const std::exception& e) {
@@ -86,16 +499,195 @@ extern "C" {
             return;
         }
 
+        if (text == nullptr || output_path == nullptr) {
+            std::cerr << "Text and output path must not be null." << std::endl;
+            return;
+        }
+
         try {
-            std::vector<std::string> phonemes = dp->g2p(text);
-            vits->tts(phonemes, output_path);
+            synthesize(text, output_path, nullptr, Babylon::request_parallelism());
         } 
         catch (const std::exception& e) {
             std::cerr << e.what() << std::endl;
         }
     }
 
+    BABYLON_EXPORT babylon_audio_t* babylon_tts_pcm(const char* text) {
+        if (vits == nullptr) {
+            std::cerr << "VITS session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        if (text == nullptr) {
+            std::cerr << "Text must not be null." << std::endl;
+            return nullptr;
+        }
+
+        babylon_audio_t* audio = static_cast<babylon_audio_t*>(std::calloc(1, sizeof(babylon_audio_t)));
+        if (audio == nullptr) {
+            return nullptr;
+        }
+        audio->sample_rate = vits->get_sample_rate();
+
+        // Chunks land straight in the buffer handed to the caller, so nothing is copied on return
+        size_t capacity = 0;
+        Babylon::AudioSink sink = [audio, &capacity](const char* data, size_t size) {
+            size_t count = size / sizeof(float);
+            if (audio->sample_count + count > capacity) {
+                size_t grown = std::max(capacity * 2, audio->sample_count + count);
+                float* samples = static_cast<float*>(std::realloc(audio->samples, grown * sizeof(float)));
+                if (samples == nullptr) {
+                    throw std::bad_alloc();
+                }
+                audio->samples = samples;
+                capacity = grown;
+            }
+
+            std::memcpy(audio->samples + audio->sample_count, data, count * sizeof(float));
+            audio->sample_count += count;
+        };
+
+        try {
+            Babylon::AudioWriter writer(sink, audio->sample_rate, Babylon::AudioFormat::FLOAT32, Babylon::AudioContainer::RAW);
+            synthesize(text, writer, nullptr, Babylon::request_parallelism());
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            babylon_audio_free(audio);
+            return nullptr;
+        }
+
+        return audio;
+    }
+
+    BABYLON_EXPORT int babylon_tts_stream(const char* text, babylon_audio_callback_t callback, void* user_data) {
+        if (vits == nullptr) {
+            std::cerr << "VITS session not initialized." << std::endl;
+            return 1;
+        }
+
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return 1;
+        }
+
+        if (text == nullptr || callback == nullptr) {
+            std::cerr << "Text and callback must not be null." << std::endl;
+            return 1;
+        }
+
+        Babylon::CancellationToken token;
+        Babylon::AudioSink sink = [callback, user_data, &token](const char* data, size_t size) {
+            if (callback(reinterpret_cast<const float*>(data), size / sizeof(float), user_data) != 0) {
+                token.cancel();
+                token.check();
+            }
+        };
+
+        try {
+            Babylon::AudioWriter writer(sink, vits->get_sample_rate(), Babylon::AudioFormat::FLOAT32, Babylon::AudioContainer::RAW, 1, STREAM_CHUNK_SIZE);
+            synthesize(text, writer, &token, Babylon::request_parallelism());
+        }
+        catch (const Babylon::Cancelled&) {
+            return 1;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    BABYLON_EXPORT void babylon_audio_free(babylon_audio_t* audio) {
+        if (audio == nullptr) {
+            return;
+        }
+
+        std::free(audio->samples);
+        std::free(audio);
+    }
+
+    BABYLON_EXPORT int babylon_tts_sample_rate(void) {
+        return vits == nullptr ? 0 : vits->get_sample_rate();
+    }
+
     BABYLON_EXPORT void babylon_tts_free(void) {
-        delete vits;
+        free_session(vits);
+    }
+
+    BABYLON_EXPORT babylon_job_t* babylon_g2p_async(const char* text, babylon_job_callback_t callback, void* user_data, unsigned int timeout_ms) {
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        return submit_job(text, nullptr, callback, user_data, timeout_ms);
+    }
+
+    BABYLON_EXPORT babylon_job_t* babylon_tts_async(const char* text, const char* output_path, babylon_job_callback_t callback, void* user_data, unsigned int timeout_ms) {
+        if (vits == nullptr) {
+            std::cerr << "VITS session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        if (dp == nullptr) {
+            std::cerr << "DeepPhonemizer session not initialized." << std::endl;
+            return nullptr;
+        }
+
+        if (output_path == nullptr) {
+            std::cerr << "Output path must not be null." << std::endl;
+            return nullptr;
+        }
+
+        return submit_job(text, output_path, callback, user_data, timeout_ms);
+    }
+
+    BABYLON_EXPORT babylon_job_status_t babylon_job_status(babylon_job_t* job) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        return job->status;
+    }
+
+    BABYLON_EXPORT babylon_job_status_t babylon_job_wait(babylon_job_t* job) {
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->condition.wait(lock, [job] {
+            return job->status != BABYLON_JOB_PENDING && job->status != BABYLON_JOB_RUNNING;
+        });
+        return job->status;
+    }
+
+    BABYLON_EXPORT void babylon_job_cancel(babylon_job_t* job) {
+        job->token.cancel();
+    }
+
+    BABYLON_EXPORT const char* babylon_job_result(babylon_job_t* job) {
+        if (babylon_job_status(job) != BABYLON_JOB_DONE) {
+            return nullptr;
+        }
+
+        return job->result.c_str();
+    }
+
+    BABYLON_EXPORT void babylon_job_free(babylon_job_t* job) {
+        if (job == nullptr) {
+            return;
+        }
+
+        // Without a callback nobody is left to collect the result, stop the work to free the CPU
+        if (job->callback == nullptr) {
+            job->token.cancel();
+        }
+        release_job(job);
+    }
+
+    BABYLON_EXPORT size_t babylon_queue_depth(void) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        return pool == nullptr ? 0 : pool->queue_depth();
     }
 }
\ No newline at end of file
@@ -0,0 +1,161 @@
+#include "babylon.h"
+#include <map>
+#include <algorithm>
+
+namespace {
+    // Terminates runs whose token passes its deadline while ORT is still inside Session::Run
+    class DeadlineWatchdog {
+        public:
+            // Every run is tracked on its own, runs of one token can start and finish at different times
+            void add(Ort::RunOptions* run, std::chrono::steady_clock::time_point deadline) {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!running) {
+                        running = true;
+                        std::thread([this] { watch(); }).detach();
+                    }
+                    deadlines.emplace(deadline, run);
+                }
+                condition.notify_all();
+            }
+
+            void remove(Ort::RunOptions* run) {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (auto it = deadlines.begin(); it != deadlines.end(); ) {
+                    it = it->second == run ? deadlines.erase(it) : std::next(it);
+                }
+            }
+
+        private:
+            std::multimap<std::chrono::steady_clock::time_point, Ort::RunOptions*> deadlines;
+            std::mutex mutex;
+            std::condition_variable condition;
+            bool running = false;
+
+            void watch() {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (true) {
+                    if (deadlines.empty()) {
+                        condition.wait(lock);
+                        continue;
+                    }
+
+                    auto earliest = deadlines.begin();
+                    if (std::chrono::steady_clock::now() < earliest->first) {
+                        condition.wait_until(lock, earliest->first);
+                        continue;
+                    }
+
+                    // Runs unregister under this lock before their options are destroyed, so the pointer is still valid
+                    earliest->second->SetTerminate();
+                    deadlines.erase(earliest);
+                }
+            }
+    };
+
+    // Never destroyed, like the idle watcher, so exit does not wait on or tear down the detached thread
+    DeadlineWatchdog& watchdog() {
+        static DeadlineWatchdog* watchdog = new DeadlineWatchdog();
+        return *watchdog;
+    }
+}
+
+namespace Babylon {
+    Cancelled::Cancelled(bool timed_out)
+        : std::runtime_error(timed_out ? "Deadline exceeded." : "Request cancelled."), timed_out(timed_out) {}
+
+    bool Cancelled::is_timeout() const {
+        return timed_out;
+    }
+
+    CancellationToken::CancellationToken() : cancelled(false), has_deadline(false) {}
+
+    CancellationToken::~CancellationToken() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto* options : runs) {
+            watchdog().remove(options);
+        }
+    }
+
+    void CancellationToken::cancel() {
+        cancelled = true;
+        terminate_runs();
+    }
+
+    void CancellationToken::set_deadline(std::chrono::steady_clock::time_point deadline) {
+        this->deadline = deadline;
+        has_deadline = true;
+    }
+
+    bool CancellationToken::is_cancelled() const {
+        return cancelled || is_expired();
+    }
+
+    bool CancellationToken::is_expired() const {
+        return has_deadline && std::chrono::steady_clock::now() >= deadline;
+    }
+
+    void CancellationToken::check() const {
+        if (cancelled) {
+            throw Cancelled(false);
+        }
+
+        if (is_expired()) {
+            throw Cancelled(true);
+        }
+    }
+
+    void CancellationToken::attach(Ort::RunOptions* options) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            runs.push_back(options);
+        }
+
+        if (has_deadline) {
+            watchdog().add(options, deadline);
+        }
+
+        // Covers a cancel that raced with the attach
+        if (is_cancelled()) {
+            options->SetTerminate();
+        }
+    }
+
+    void CancellationToken::detach(Ort::RunOptions* options) {
+        watchdog().remove(options);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        runs.erase(std::remove(runs.begin(), runs.end(), options), runs.end());
+    }
+
+    void CancellationToken::terminate_runs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto* options : runs) {
+            options->SetTerminate();
+        }
+    }
+
+    std::vector<Ort::Value> run(Ort::Session* session, const char* const* input_names, const Ort::Value* input_tensors, size_t input_count, const char* const* output_names, size_t output_count, CancellationToken* token) {
+        Ort::RunOptions run_options;
+
+        if (token == nullptr) {
+            return session->Run(run_options, input_names, input_tensors, input_count, output_names, output_count);
+        }
+
+        token->check();
+        token->attach(&run_options);
+
+        try {
+            std::vector<Ort::Value> output_tensors = session->Run(run_options, input_names, input_tensors, input_count, output_names, output_count);
+            token->detach(&run_options);
+            return output_tensors;
+        }
+        catch (const Ort::Exception&) {
+            token->detach(&run_options);
+
+            // A terminated run surfaces as a generic ORT error, report why it was stopped instead
+            token->check();
+            throw;
+        }
+    }
+}
@@ -1,11 +1,89 @@
+#include "babylon.h"
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <algorithm>
-#include <iostream>
-#include <sstream>
-#include <unordered_map>
+#include <cstdint>
+#include <cctype>
 
-std::unordered_map<std::string, std::string> abbreviations = {
+struct Abbreviation {
+    std::string_view key;
+    std::string_view expansion;
+};
+
+// Open addressing table whose hash seed is searched at compile time so every key gets its own slot
+class AbbreviationTable {
+    public:
+        static constexpr size_t capacity = 128;
+
+        template <size_t N>
+        constexpr AbbreviationTable(const std::array<Abbreviation, N>& entries)
+            : entries(entries.data()), seed(0), slots() {
+            static_assert(N * 2 <= capacity, "Too many abbreviations for the table capacity.");
+
+            while (!try_seed(N, seed)) {
+                seed++;
+            }
+        }
+
+        constexpr std::string_view find(std::string_view key) const {
+            int16_t index = slots[hash(key, seed) % capacity];
+
+            if (index >= 0 && entries[index].key == key) {
+                return entries[index].expansion;
+            }
+
+            return {};
+        }
+
+    private:
+        const Abbreviation* entries;
+        uint32_t seed;
+        std::array<int16_t, capacity> slots;
+
+        // FNV-1a
+        static constexpr uint32_t hash(std::string_view key, uint32_t seed) {
+            uint32_t h = 2166136261u ^ seed;
+            for (char c : key) {
+                h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+            }
+            return h;
+        }
+
+        constexpr bool try_seed(size_t count, uint32_t candidate) {
+            for (auto& slot : slots) {
+                slot = -1;
+            }
+
+            for (size_t i = 0; i < count; i++) {
+                int16_t& slot = slots[hash(entries[i].key, candidate) % capacity];
+                if (slot != -1) {
+                    return false;
+                }
+                slot = static_cast<int16_t>(i);
+            }
+
+            return true;
+        }
+};
+
+struct NumberWords {
+    std::array<std::string_view, 10> ones;
+    std::array<std::string_view, 10> teens;     // 10 to 19
+    std::array<std::string_view, 10> tens;
+    std::string_view hundred;
+    std::string_view conjunction;
+    std::array<std::string_view, 11> scales;    // thousand and up
+};
+
+struct NormalizationTable {
+    std::string_view language;
+    const NumberWords& numbers;
+    const AbbreviationTable& abbreviations;
+};
+
+constexpr std::array<Abbreviation, 19> english_abbreviation_entries = {{
     {"mrs", "misess"},
     {"mr", "mister"},
     {"dr", "doctor"},
@@ -25,189 +103,310 @@ std::unordered_map<std::string, std::string> abbreviations = {
     {"col", "colonel"},
     {"ft", "foot"},
     {"pty", "proprietary"}
-};
+}};
 
-std::vector<std::string> split_into_threes(const std::string& str) {
-    std::vector<std::string> parts;
+constexpr AbbreviationTable english_abbreviations(english_abbreviation_entries);
 
-    // Process the string from the end
-    for (int i = str.length(); i > 0; i -= 3) {
-        if (i < 3) {
-            parts.push_back(str.substr(0, i));
-        } else {
-            parts.push_back(str.substr(i - 3, 3));
-        }
-    }
+constexpr NumberWords english_numbers = {
+    {"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"},
+    {"ten", "eleven", "twelve", "thirteen", "fourteen", "fifteen", "sixteen", "seventeen", "eighteen", "nineteen"},
+    {"", "ten", "twenty", "thirty", "forty", "fifty", "sixty", "seventy", "eighty", "ninety"},
+    "hundred",
+    "and",
+    {"thousand", "million", "billion", "trillion", "quadrillion", "quintillion", "sextillion", "septillion", "octillion", "nonillion", "decillion"}
+};
 
-    // Since we processed from the end, reverse the order of parts
-    std::reverse(parts.begin(), parts.end());
+// Languages without their own entry fall back to the first table
+constexpr std::array<NormalizationTable, 1> normalization_tables = {{
+    {"en_us", english_numbers, english_abbreviations}
+}};
 
-    return parts;
-}
-
-std::string number_to_word(int number) {
-    switch (number) {
-        case 0:
-            return "zero";
-        case 1:
-            return "one";
-        case 2:
-            return "two";
-        case 3:
-            return "three";
-        case 4:
-            return "four";
-        case 5:
-            return "five";
-        case 6:
-            return "six";
-        case 7:
-            return "seven";
-        case 8:
-            return "eight";
-        case 9:
-            return "nine";
-        default:
-            return std::string(1, number);
-    }
-}
+static_assert(english_abbreviations.find("dr") == "doctor", "Abbreviation table must resolve at compile time.");
 
-std::string tens_to_word(int tens) {
-    switch (tens) {
-        case 1:
-            return "ten";
-        case 2:
-            return "twenty";
-        case 3:
-            return "thirty";
-        case 4:
-            return "forty";
-        case 5:
-            return "fifty";
-        case 6:
-            return "sixty";
-        case 7:
-            return "seventy";
-        case 8:
-            return "eighty";
-        case 9:
-            return "ninety";
-        default:
-            return "";
+constexpr const NormalizationTable& find_table(std::string_view language) {
+    for (const auto& table : normalization_tables) {
+        if (table.language == language) {
+            return table;
+        }
     }
-}
 
-std::string teens_to_word(int teens) {
-    switch (teens) {
-        case 11:
-            return "eleven";
-        case 12:
-            return "twelve";
-        case 13:
-            return "thirteen";
-        case 14:
-            return "fourteen";
-        case 15:
-            return "fifteen";
-        case 16:
-            return "sixteen";
-        case 17:
-            return "seventeen";
-        case 18:
-            return "eighteen";
-        case 19:
-            return "nineteen";
-        default:
-            return "";
-    }
+    return normalization_tables[0];
 }
 
-std::vector<std::string> hundreds_to_words(int hundreds) {
+void hundreds_to_words(int hundreds, const NumberWords& numbers, std::vector<std::string_view>& out) {
     const int hundreds_digit = hundreds / 100;
     const int tens_digit = (hundreds % 100) / 10;
     const int ones_digit = hundreds % 10;
 
-    std::vector<std::string> result;
-
     if (hundreds_digit > 0) {
-        result.push_back(number_to_word(hundreds_digit));
-        result.push_back("hundred");
+        out.push_back(numbers.ones[hundreds_digit]);
+        out.push_back(numbers.hundred);
 
         if (tens_digit > 0 || ones_digit > 0) {
-            result.push_back("and");
+            out.push_back(numbers.conjunction);
         }
     }
 
     if (tens_digit > 1) {
-        result.push_back(tens_to_word(tens_digit));
+        out.push_back(numbers.tens[tens_digit]);
     } else if (tens_digit == 1) {
-        result.push_back(teens_to_word(hundreds % 100));
+        out.push_back(numbers.teens[ones_digit]);
     }
 
     if (ones_digit > 0 && tens_digit != 1) {
-        result.push_back(number_to_word(ones_digit));
+        out.push_back(numbers.ones[ones_digit]);
+    }
+}
+
+// Appends the words for a string of digits, read in groups of three from the left
+void numbers_to_words(std::string_view digits, const NumberWords& numbers, std::vector<std::string_view>& out) {
+    if (digits.empty()) {
+        return;
     }
 
-    return result;
+    size_t expanded = out.size();
+    size_t groups = (digits.size() + 2) / 3;
+    size_t group_start = 0;
+    size_t group_length = digits.size() - (groups - 1) * 3;
+
+    for (size_t i = 0; i < groups; i++) {
+        int number = 0;
+        for (char digit : digits.substr(group_start, group_length)) {
+            number = number * 10 + (digit - '0');
+        }
+
+        hundreds_to_words(number, numbers, out);
+
+        // Groups beyond the largest scale word are read out without one
+        size_t scale = groups - i - 2;
+        if (number > 0 && i < groups - 1 && scale < numbers.scales.size()) {
+            out.push_back(numbers.scales[scale]);
+        }
+
+        group_start += group_length;
+        group_length = 3;
+    }
+
+    if (out.size() == expanded) {
+        out.push_back(numbers.ones[0]);
+    }
 }
 
-std::vector<std::string> numbers_to_words(const std::string& text) {
-    const std::vector<std::string> suffixes = {
-        "thousand", 
-        "million", 
-        "billion", 
-        "trillion", 
-        "quadrillion", 
-        "quintillion",
-        "sextillion",
-        "septillion",
-        "octillion",
-        "nonillion",
-        "decillion"
-    };
+// Silence after each kind of boundary, in seconds
+constexpr float SENTENCE_PAUSE = 0.4f;
+constexpr float CLAUSE_PAUSE = 0.25f;   // ; and :
+constexpr float COMMA_PAUSE = 0.15f;
+constexpr float PARAGRAPH_PAUSE = 0.75f;
+
+static bool is_space_at(const std::string& text, size_t i) {
+    return i >= text.size() || std::isspace(static_cast<unsigned char>(text[i]));
+}
+
+// Length of a closing quote or bracket at i, handles the UTF-8 right quotes
+static size_t closing_length(const std::string& text, size_t i) {
+    if (i >= text.size()) {
+        return 0;
+    }
+
+    char c = text[i];
+    if (c == '"' || c == '\'' || c == ')' || c == ']') {
+        return 1;
+    }
 
-    const std::vector<std::string> parts = split_into_threes(text);
+    if (text.compare(i, 3, "\xE2\x80\x9D") == 0 || text.compare(i, 3, "\xE2\x80\x99") == 0) {
+        return 3;
+    }
 
-    std::vector<std::string> result;
+    return 0;
+}
 
-    for (int i = 0; i < parts.size(); i++) {
-        int number = std::stoi(parts[i]);
-        std::vector<std::string> words = hundreds_to_words(number);
+// An uppercase letter with a period right after it, as in "J." of "J. R. R. Tolkien"
+static bool is_initial(const std::string& text, size_t letter) {
+    return letter + 1 < text.size() && std::isupper(static_cast<unsigned char>(text[letter])) && text[letter + 1] == '.';
+}
 
-        result.insert(result.end(), words.begin(), words.end());
+// A period after a known abbreviation, a run of initials or a dotted abbreviation does not end the sentence
+static bool is_abbreviation(const std::string& text, size_t start, size_t period, const NormalizationTable& table) {
+    size_t word_start = period;
+    while (word_start > start && !std::isspace(static_cast<unsigned char>(text[word_start - 1]))) {
+        word_start--;
+    }
+
+    std::string word;
+    for (size_t i = word_start; i < period; i++) {
+        char c = text[i];
+        if (c == '.') {
+            return true;
+        }
+        if (!std::ispunct(static_cast<unsigned char>(c))) {
+            word.push_back(std::tolower(static_cast<unsigned char>(c)));
+        }
+    }
 
-        if (i < suffixes.size() && i < parts.size() - 1) {
-            int suffix = parts.size() - i - 2;
+    // A lone letter is only an initial inside a run, otherwise "Plan A. Next" would never split
+    if (period - word_start == 1 && is_initial(text, word_start)) {
+        size_t next = period + 1;
+        while (next < text.size() && std::isspace(static_cast<unsigned char>(text[next]))) {
+            next++;
+        }
+        if (is_initial(text, next) && (next + 2 == text.size() || std::isspace(static_cast<unsigned char>(text[next + 2])))) {
+            return true;
+        }
 
-            result.push_back(suffixes[suffix]);
+        size_t previous = word_start;
+        while (previous > start && std::isspace(static_cast<unsigned char>(text[previous - 1]))) {
+            previous--;
+        }
+        if (previous < word_start && previous >= start + 2 && is_initial(text, previous - 2) && (previous - 2 == start || std::isspace(static_cast<unsigned char>(text[previous - 3])))) {
+            return true;
         }
     }
 
-    return result;
+    return !table.abbreviations.find(word).empty();
 }
 
 namespace DeepPhonemizer {
-    std::vector<std::string> clean_text(const std::string& text) {
-        std::vector<std::string> words;
+    std::vector<Segment> segment_text(const std::string& text, const std::string& language) {
+        const NormalizationTable& table = find_table(language);
+        std::vector<Segment> segments;
+
+        auto push_segment = [&](size_t start, size_t end, float pause) {
+            while (start < end && std::isspace(static_cast<unsigned char>(text[start]))) {
+                start++;
+            }
+            while (end > start && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+                end--;
+            }
+
+            if (start < end) {
+                segments.push_back({text.substr(start, end - start), pause});
+            }
+            else if (!segments.empty()) {
+                segments.back().pause = std::max(segments.back().pause, pause);
+            }
+        };
+
+        size_t start = 0;
+        for (size_t i = 0; i < text.size(); i++) {
+            char c = text[i];
+            size_t end = i + 1;
+            float pause;
+
+            if (c == '.' || c == '!' || c == '?') {
+                // Runs like ?! or ... and the quotes closing the sentence stay with it
+                while (end < text.size() && (text[end] == '.' || text[end] == '!' || text[end] == '?')) {
+                    end++;
+                }
+                while (size_t length = closing_length(text, end)) {
+                    end += length;
+                }
+
+                // Decimals, dotted abbreviations and initials are not boundaries
+                if (!is_space_at(text, end) || (c == '.' && end == i + 1 && is_abbreviation(text, start, i, table))) {
+                    continue;
+                }
+
+                pause = SENTENCE_PAUSE;
+            }
+            else if (c == ',' || c == ';' || c == ':') {
+                while (size_t length = closing_length(text, end)) {
+                    end += length;
+                }
+
+                // Thousands separators and times are not boundaries
+                if (!is_space_at(text, end)) {
+                    continue;
+                }
+
+                pause = c == ',' ? COMMA_PAUSE : CLAUSE_PAUSE;
+            }
+            else if (c == '\n') {
+                size_t next = end;
+                while (next < text.size() && text[next] != '\n' && std::isspace(static_cast<unsigned char>(text[next]))) {
+                    next++;
+                }
+
+                if (next >= text.size() || text[next] != '\n') {
+                    continue;
+                }
 
-        std::stringstream ss(text);
-        std::string word;
-        while (ss >> word) {
-            std::string cleaned_word(word);
-            cleaned_word.erase(std::remove_if(cleaned_word.begin(), cleaned_word.end(), ::ispunct), cleaned_word.end());
+                end = next + 1;
+                pause = PARAGRAPH_PAUSE;
+            }
+            else {
+                continue;
+            }
+
+            push_segment(start, end, pause);
+            start = end;
+            i = end - 1;
+        }
+
+        push_segment(start, text.size(), 0.0f);
+
+        // No silence after the last segment
+        if (!segments.empty()) {
+            segments.back().pause = 0.0f;
+        }
+
+        return segments;
+    }
+
+    void clean_text(std::string_view text, std::string_view language, std::vector<std::string_view>& words) {
+        const NormalizationTable& table = find_table(language);
+        std::string scratch;
+
+        auto is_space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+
+        size_t position = 0;
+        while (position < text.size()) {
+            while (position < text.size() && is_space(text[position])) {
+                position++;
+            }
 
-            if (std::all_of(cleaned_word.begin(), cleaned_word.end(), ::isdigit)) {
-                std::vector<std::string> number_words = numbers_to_words(cleaned_word);
-                words.insert(words.end(), number_words.begin(), number_words.end());
+            size_t word_start = position;
+            while (position < text.size() && !is_space(text[position])) {
+                position++;
             }
-            else if (abbreviations.find(word) != abbreviations.end()) {
-                words.push_back(abbreviations[word]);
+
+            if (word_start == position) {
+                break;
+            }
+
+            std::string_view word = text.substr(word_start, position - word_start);
+
+            scratch.clear();
+            bool all_digits = true;
+            for (char c : word) {
+                if (!std::ispunct(static_cast<unsigned char>(c))) {
+                    scratch.push_back(c);
+                    all_digits = all_digits && std::isdigit(static_cast<unsigned char>(c));
+                }
+            }
+
+            std::string_view expansion = table.abbreviations.find(word);
+
+            // Punctuation only words are dropped along with the numbers they would have been
+            if (all_digits) {
+                numbers_to_words(scratch, table.numbers, words);
+            }
+            else if (!expansion.empty()) {
+                words.push_back(expansion);
             }
             else {
                 words.push_back(word);
             }
         }
+    }
 
-        return words;
+    std::vector<std::string> clean_text(const std::string& text, const std::string& language) {
+        std::vector<std::string_view> word_views;
+        clean_text(text, language, word_views);
+
+        return std::vector<std::string>(word_views.begin(), word_views.end());
     }
-}
\ No newline at end of file
+
+    std::vector<std::string> clean_text(const std::string& text) {
+        return clean_text(text, std::string(normalization_tables[0].language));
+    }
+}
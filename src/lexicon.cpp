@@ -0,0 +1,154 @@
+#include "babylon.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+namespace DeepPhonemizer {
+    Lexicon::Lexicon() : entries(std::make_shared<const Entries>()), lookups(0), hits(0), reloads(0) {}
+
+    std::string Lexicon::normalize(const std::string& word) {
+        std::string key = word;
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+        key.erase(std::remove_if(key.begin(), key.end(), [](unsigned char c) { return std::ispunct(c); }), key.end());
+        return key;
+    }
+
+    void Lexicon::set_phonemes(const std::vector<std::string>& phonemes) {
+        known_phonemes = std::unordered_set<std::string>(phonemes.begin(), phonemes.end());
+    }
+
+    const std::string* Lexicon::find_unknown(const std::vector<std::string>& phonemes) const {
+        if (known_phonemes.empty()) {
+            return nullptr;
+        }
+
+        auto unknown = std::find_if(phonemes.begin(), phonemes.end(), [this](const std::string& phoneme) {
+            return known_phonemes.count(phoneme) == 0;
+        });
+        return unknown != phonemes.end() ? &*unknown : nullptr;
+    }
+
+    void Lexicon::load(const std::string& path, const std::string& language) {
+        std::ifstream file(path);
+        if (!file) {
+            throw std::runtime_error("Failed to open lexicon: " + path);
+        }
+
+        // Parse before taking the lock, a slow or broken file leaves the current entries in place
+        std::unordered_map<std::string, std::vector<std::string>> words;
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(file, line)) {
+            line_number++;
+
+            size_t comment = line.find('#');
+            if (comment != std::string::npos) {
+                line.erase(comment);
+            }
+
+            std::stringstream line_stream(line);
+            std::string word;
+            if (!(line_stream >> word)) {
+                continue;
+            }
+
+            std::vector<std::string> phonemes;
+            std::string phoneme;
+            while (line_stream >> phoneme) {
+                phonemes.push_back(phoneme);
+            }
+
+            if (phonemes.empty()) {
+                throw std::runtime_error("Lexicon " + path + " line " + std::to_string(line_number) + ": no phonemes for " + word);
+            }
+
+            if (const std::string* unknown = find_unknown(phonemes)) {
+                throw std::runtime_error("Lexicon " + path + " line " + std::to_string(line_number) + ": unknown phoneme " + *unknown + " for " + word);
+            }
+
+            words[normalize(word)] = std::move(phonemes);
+        }
+
+        update([&](Entries& next) {
+            next[language] = std::move(words);
+        });
+
+        reloads.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void Lexicon::set(const std::string& word, const std::vector<std::string>& phonemes, const std::string& language) {
+        if (phonemes.empty()) {
+            throw std::invalid_argument("Lexicon entry for " + word + " has no phonemes.");
+        }
+
+        if (const std::string* unknown = find_unknown(phonemes)) {
+            throw std::invalid_argument("Lexicon entry for " + word + " has unknown phoneme " + *unknown + ".");
+        }
+
+        update([&](Entries& next) {
+            next[language][normalize(word)] = phonemes;
+        });
+    }
+
+    bool Lexicon::remove(const std::string& word, const std::string& language) {
+        bool removed = false;
+
+        update([&](Entries& next) {
+            auto words = next.find(language);
+            removed = words != next.end() && words->second.erase(normalize(word)) > 0;
+        });
+
+        return removed;
+    }
+
+    void Lexicon::clear() {
+        update([](Entries& next) {
+            next.clear();
+        });
+    }
+
+    bool Lexicon::lookup(const std::string& word, const std::string& language, std::vector<std::string>& phonemes) const {
+        lookups.fetch_add(1, std::memory_order_relaxed);
+
+        // The snapshot stays alive for this lookup even if an update swaps it out meanwhile
+        std::shared_ptr<const Entries> snapshot = std::atomic_load(&entries);
+        if (snapshot->empty()) {
+            return false;
+        }
+
+        auto words = snapshot->find(language);
+        if (words == snapshot->end()) {
+            return false;
+        }
+
+        auto entry = words->second.find(normalize(word));
+        if (entry == words->second.end()) {
+            return false;
+        }
+
+        phonemes = entry->second;
+        hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Lexicon::Stats Lexicon::get_stats() const {
+        std::shared_ptr<const Entries> snapshot = std::atomic_load(&entries);
+
+        size_t count = 0;
+        for (const auto& words : *snapshot) {
+            count += words.second.size();
+        }
+
+        return {lookups.load(std::memory_order_relaxed), hits.load(std::memory_order_relaxed), reloads.load(std::memory_order_relaxed), count};
+    }
+
+    void Lexicon::update(const std::function<void(Entries&)>& change) {
+        // Writers are serialized so concurrent updates cannot drop each other's changes
+        std::lock_guard<std::mutex> lock(update_mutex);
+
+        auto next = std::make_shared<Entries>(*std::atomic_load(&entries));
+        change(*next);
+        std::atomic_store(&entries, std::shared_ptr<const Entries>(std::move(next)));
+    }
+}
@@ -46,8 +46,13 @@ std::unordered_map<std::string, std::vector<std::string>> process_dictionary(con
 
 namespace DeepPhonemizer {
     SequenceTokenizer::SequenceTokenizer(const std::vector<std::string>& symbols, const std::vector<std::string>& languages, int char_repeats, bool lowercase, bool append_start_end)
-        : char_repeats(char_repeats), lowercase(lowercase), append_start_end(append_start_end), pad_token(" "), end_token("<end>") {
-        
+        : char_repeats(char_repeats), lowercase(lowercase), append_start_end(append_start_end), pad_index(0), pad_token(" "), end_token("<end>") {
+
+        // Decoding steps through the sequence char_repeats at a time
+        if (char_repeats < 1) {
+            throw std::invalid_argument("char_repeats must be at least 1.");
+        }
+
         tokens.push_back(pad_token);
         special_tokens.insert(pad_token);
 
@@ -102,6 +107,10 @@ namespace DeepPhonemizer {
     }
 
     std::vector<std::string> SequenceTokenizer::decode(const std::vector<int64_t>& sequence) const {
+        if (sequence.empty()) {
+            return {};
+        }
+
         std::vector<int64_t> processed_sequence;
         if (append_start_end) {
             processed_sequence.push_back(sequence.front());
@@ -120,6 +129,12 @@ namespace DeepPhonemizer {
             if (token == end_index) {
                 break;
             }
+
+            // Model output and caller supplied IDs may fall outside the vocabulary
+            if (token < 0 || token >= static_cast<int64_t>(tokens.size())) {
+                continue;
+            }
+
             decoded.push_back(tokens[token]);
         }
 
@@ -160,15 +175,15 @@ namespace DeepPhonemizer {
         return -1;
     }
 
-    Session::Session(const std::string& model_path, const std::string language, const bool use_dictionaries, const bool use_punctuation) {
-        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "DeepPhonemizer");
-        env.DisableTelemetryEvents();
-
+    Session::Session(const std::string& model_path, const std::string language, const bool use_dictionaries, const bool use_punctuation, const Babylon::ModelOptions& options)
+        : dictionary_only(false), skipped_words(0) {
         Ort::SessionOptions session_options;
-        session_options.SetIntraOpNumThreads(1);
+        Babylon::use_global_threads(session_options);
         session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
 
-        this->session = new Ort::Session(env, (const ORTCHAR_T *) model_path.c_str(), session_options);
+        this->model = std::make_unique<Babylon::ModelHandle>(model_path, session_options, options);
+        std::shared_ptr<Ort::Session> session = model->acquire();
+        this->quantization = Babylon::detect_quantization(session.get());
 
         // Load metadata from the model
         Ort::ModelMetadata model_metadata = session->GetModelMetadata();
@@ -176,7 +191,6 @@ namespace DeepPhonemizer {
 
         std::string langs_str = model_metadata.LookupCustomMetadataMapAllocated("languages", allocator).get();
 
-        std::vector<std::string> languages;
         std::stringstream languages_stream(langs_str);
         std::string language_buffer;
         while (languages_stream >> language_buffer) {
@@ -201,14 +215,6 @@ namespace DeepPhonemizer {
             phoneme_symbols.push_back(phoneme_symbol_buffer);
         }
 
-        if (use_dictionaries) {
-            for (const auto& lang : languages) {
-                std::string key = lang + "_dictionary";
-                std::string dictonary_str = model_metadata.LookupCustomMetadataMapAllocated(key.c_str(), allocator).get();
-                this->dictionaries[lang] = process_dictionary(dictonary_str);
-            }
-        }
-
         int char_repeats = model_metadata.LookupCustomMetadataMapAllocated("char_repeats", allocator).get()[0] - '0';
 
         bool lowercase = model_metadata.LookupCustomMetadataMapAllocated("lowercase", allocator).get()[0] == '1';
@@ -222,74 +228,291 @@ namespace DeepPhonemizer {
         this->use_punctuation = use_punctuation;
         this->text_tokenizer = new SequenceTokenizer(text_symbols, languages, char_repeats, lowercase);
         this->phoneme_tokenizer = new SequenceTokenizer(phoneme_symbols, languages, 1, false);
+        this->lexicon.set_phonemes(phoneme_symbols);
+
+        // Models exported with a dynamic batch axis take every word of a request in one run
+        std::vector<int64_t> input_shape = session->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        this->max_batch_size = !input_shape.empty() && input_shape[0] < 0 ? 64 : 1;
+
+        // Keep the dictionary metadata of a model that gets released, parsing it later must not load the model again
+        if (use_dictionaries && (options.lazy_load || options.idle_timeout.count() > 0)) {
+            for (const auto& lang : languages) {
+                std::string key = lang + "_dictionary";
+                dictionary_sources[lang] = Babylon::lookup_metadata(model_metadata, key.c_str(), "");
+            }
+        }
+
+        // The parsed dictionaries are only worth their memory while the model is in use
+        model->set_on_release([this] {
+            std::lock_guard<std::mutex> lock(dictionaries_mutex);
+            dictionaries.clear();
+        });
+
+        if (options.lazy_load) {
+            session.reset();
+            model->release();
+        }
     }
 
     Session::~Session() {
-        delete session;
+        // Before the dictionaries its release callback clears, the idle watcher may be releasing it right now
+        model.reset();
         delete text_tokenizer;
         delete phoneme_tokenizer;
     }
 
-    std::vector<std::string> Session::g2p(const std::string& text) {
+    const std::string& Session::get_quantization() const {
+        return quantization;
+    }
+
+    const std::string& Session::get_language() const {
+        return language;
+    }
+
+    const std::vector<std::string>& Session::get_languages() const {
+        return languages;
+    }
+
+    Lexicon& Session::get_lexicon() {
+        return lexicon;
+    }
+
+    void Session::set_dictionary_only(bool dictionary_only) {
+        this->dictionary_only = dictionary_only;
+    }
+
+    bool Session::is_dictionary_only() const {
+        return dictionary_only;
+    }
+
+    uint64_t Session::get_skipped_words() const {
+        return skipped_words;
+    }
+
+    void Session::unload() {
+        model->release();
+    }
+
+    bool Session::is_loaded() const {
+        return model->is_loaded();
+    }
+
+    size_t Session::get_model_bytes() const {
+        return model->get_resident_bytes();
+    }
+
+    size_t Session::get_dictionary_bytes() const {
+        std::lock_guard<std::mutex> lock(dictionaries_mutex);
+
+        // Buckets, hash nodes, phoneme vectors and string capacity, an upper bound with small strings
+        size_t bytes = 0;
+        for (const auto& [language, source] : dictionary_sources) {
+            bytes += source.capacity();
+        }
+        for (const auto& [language, dictionary] : dictionaries) {
+            bytes += dictionary->bucket_count() * sizeof(void*);
+            for (const auto& [word, phonemes] : *dictionary) {
+                bytes += sizeof(Dictionary::value_type) + sizeof(void*) + word.capacity();
+                bytes += phonemes.capacity() * sizeof(std::string);
+                for (const auto& phoneme : phonemes) {
+                    bytes += phoneme.capacity();
+                }
+            }
+        }
+
+        return bytes;
+    }
+
+    std::vector<std::string> Session::g2p(const std::string& text, Babylon::CancellationToken* token) {
+        return g2p(text, language, token);
+    }
+
+    std::vector<std::string> Session::g2p(const std::string& text, const std::string& language, Babylon::CancellationToken* token) {
+        return g2p_batch({text}, {language}, token).front();
+    }
+
+    std::vector<int64_t> Session::g2p_tokens(const std::string& text, Babylon::CancellationToken* token) {
+        return g2p_tokens(text, language, token);
+    }
+
+    std::vector<int64_t> Session::g2p_tokens(const std::string& text, const std::string& language, Babylon::CancellationToken* token) {
+        return g2p_tokens_batch({text}, {language}, token).front();
+    }
+
+    std::vector<std::vector<std::string>> Session::g2p_batch(const std::vector<std::string>& texts, const std::vector<std::string>& languages, Babylon::CancellationToken* token) {
         // Convert input text to phonemes
-        std::vector<int64_t> phoneme_tokens = g2p_tokens(text);
+        std::vector<std::vector<int64_t>> phoneme_tokens = g2p_tokens_batch(texts, languages, token);
 
         // Decode the phoneme tokens
-        return phoneme_tokenizer->decode(phoneme_tokens);
+        std::vector<std::vector<std::string>> phonemes;
+        for (const auto& tokens : phoneme_tokens) {
+            phonemes.push_back(phoneme_tokenizer->decode(tokens));
+        }
+
+        return phonemes;
     }
 
-    std::vector<int64_t> Session::g2p_tokens(const std::string& text) {
-        // Clean the input text
-        std::vector<std::string> words = clean_text(text);
+    std::vector<std::vector<int64_t>> Session::g2p_tokens_batch(const std::vector<std::string>& texts, const std::vector<std::string>& languages, Babylon::CancellationToken* token) {
+        if (texts.size() != languages.size()) {
+            throw std::invalid_argument("Every text needs a language.");
+        }
+
+        for (const auto& lang : languages) {
+            if (std::find(this->languages.begin(), this->languages.end(), lang) == this->languages.end()) {
+                throw std::runtime_error("Language not supported: " + lang);
+            }
+        }
 
-        // Convert each word to phonemes
-        std::vector<int64_t> phoneme_ids;
-        for (const auto& word : words) {
-            std::vector<int64_t> word_phoneme_ids = g2p_tokens_internal(word);
+        // Clean the input texts, dictionary words are resolved straight away
+        std::vector<std::vector<std::string>> words(texts.size());
+        std::vector<std::vector<std::vector<int64_t>>> word_phoneme_ids(texts.size());
+        std::vector<std::vector<bool>> skipped(texts.size());
+
+        std::vector<std::string> model_words;
+        std::vector<std::string> model_languages;
+        std::vector<std::vector<int64_t>*> model_outputs;
+
+        bool skip_unknown = dictionary_only;
+
+        for (size_t i = 0; i < texts.size(); i++) {
+            words[i] = clean_text(texts[i], languages[i]);
+            word_phoneme_ids[i].resize(words[i].size());
+            skipped[i].resize(words[i].size(), false);
+
+            for (size_t j = 0; j < words[i].size(); j++) {
+                if (!lookup_dictionary(words[i][j], languages[i], word_phoneme_ids[i][j])) {
+                    if (skip_unknown) {
+                        skipped_words++;
+                        skipped[i][j] = true;
+                        continue;
+                    }
+
+                    model_words.push_back(words[i][j]);
+                    model_languages.push_back(languages[i]);
+                    model_outputs.push_back(&word_phoneme_ids[i][j]);
+                }
+            }
+        }
 
-            std::vector<int64_t> cleaned_word_phoneme_ids = phoneme_tokenizer->clean(word_phoneme_ids);
-            
-            phoneme_ids.insert(phoneme_ids.end(), cleaned_word_phoneme_ids.begin(), cleaned_word_phoneme_ids.end());
+        // Remaining words go through the model, mixed languages share a batch since the language is only the start token
+        for (size_t start = 0; start < model_words.size(); start += max_batch_size) {
+            if (token != nullptr) {
+                token->check();
+            }
 
-            if (use_punctuation) {
-                auto back_token = phoneme_tokenizer->get_token(std::string(1, word.back()));
+            size_t end = std::min(start + max_batch_size, model_words.size());
+            std::vector<std::vector<int64_t>> outputs = g2p_tokens_internal(
+                std::vector<std::string>(model_words.begin() + start, model_words.begin() + end),
+                std::vector<std::string>(model_languages.begin() + start, model_languages.begin() + end),
+                token
+            );
 
-                // Check if the word ends with punctuation
-                if (std::ispunct(word.back()) && back_token != -1) {
-                    phoneme_ids.push_back(back_token);
-                }
+            for (size_t k = 0; k < outputs.size(); k++) {
+                *model_outputs[start + k] = std::move(outputs[k]);
             }
+        }
 
-            phoneme_ids.push_back(0);
+        std::vector<std::vector<int64_t>> phoneme_ids(texts.size());
+        for (size_t i = 0; i < texts.size(); i++) {
+            for (size_t j = 0; j < words[i].size(); j++) {
+                // Skipped words leave no trace, not even their punctuation or separator
+                if (skipped[i][j]) {
+                    continue;
+                }
+
+                const std::string& word = words[i][j];
+
+                std::vector<int64_t> cleaned_word_phoneme_ids = phoneme_tokenizer->clean(word_phoneme_ids[i][j]);
+                
+                phoneme_ids[i].insert(phoneme_ids[i].end(), cleaned_word_phoneme_ids.begin(), cleaned_word_phoneme_ids.end());
+
+                if (use_punctuation) {
+                    auto back_token = phoneme_tokenizer->get_token(std::string(1, word.back()));
+
+                    // Check if the word ends with punctuation
+                    if (std::ispunct(word.back()) && back_token != -1) {
+                        phoneme_ids[i].push_back(back_token);
+                    }
+                }
+
+                phoneme_ids[i].push_back(0);
+            }
         }
 
         return phoneme_ids;
     }
 
-    std::vector<int64_t> Session::g2p_tokens_internal(const std::string& text) {
-        // Check if the input text is longer than one character
-        std::string key_text = text;
-        std::transform(key_text.begin(), key_text.end(), key_text.begin(), ::tolower);
+    bool Session::lookup_dictionary(const std::string& word, const std::string& language, std::vector<int64_t>& tokens) {
+        // User overrides win over the model dictionaries and apply even when those are disabled
+        std::vector<std::string> phonemes;
+        if (lexicon.lookup(word, language, phonemes)) {
+            to_tokens(phonemes, tokens);
+            return true;
+        }
+
+        if (!use_dictionaries) {
+            return false;
+        }
+
+        std::shared_ptr<const Dictionary> dictionary = get_dictionary(language);
+        auto entry = dictionary->find(Lexicon::normalize(word));
+        if (entry == dictionary->end()) {
+            return false;
+        }
 
-        key_text.erase(std::remove_if(key_text.begin(), key_text.end(), ::ispunct), key_text.end());
+        to_tokens(entry->second, tokens);
+        return true;
+    }
 
-        // First check if word is in the dictionary
-        if (dictionaries[language].count(key_text) && use_dictionaries) {
-            auto token_str = dictionaries[language].at(key_text);
+    void Session::to_tokens(const std::vector<std::string>& phonemes, std::vector<int64_t>& tokens) const {
+        tokens.clear();
+        for (const auto& phoneme : phonemes) {
+            // Lexicon entries are checked against the phoneme symbols, only a dictionary can hold phonemes without a token
+            int64_t token = phoneme_tokenizer->get_token(phoneme);
+            if (token != -1) {
+                tokens.push_back(token);
+            }
+        }
+    }
 
-            std::vector<int64_t> tokens;
-            for (const auto& token : token_str) {
-                tokens.push_back(phoneme_tokenizer->get_token(token));
+    std::shared_ptr<const Session::Dictionary> Session::get_dictionary(const std::string& language) {
+        {
+            std::lock_guard<std::mutex> lock(dictionaries_mutex);
+            auto it = dictionaries.find(language);
+            if (it != dictionaries.end()) {
+                return it->second;
             }
+        }
 
-            return tokens;
+        // Dictionaries are parsed the first time their language is used, callers keep theirs alive across an unload
+        std::string metadata;
+        const std::string* source = &metadata;
+        auto kept = dictionary_sources.find(language);
+        if (kept != dictionary_sources.end()) {
+            source = &kept->second;
         }
+        else if (dictionary_sources.empty()) {
+            std::shared_ptr<Ort::Session> session = model->acquire();
+            std::string key = language + "_dictionary";
+            metadata = Babylon::lookup_metadata(session->GetModelMetadata(), key.c_str(), "");
+        }
+        auto dictionary = std::make_shared<const Dictionary>(process_dictionary(*source));
+
+        std::lock_guard<std::mutex> lock(dictionaries_mutex);
+        return dictionaries.emplace(language, dictionary).first->second;
+    }
 
+    std::vector<std::vector<int64_t>> Session::g2p_tokens_internal(const std::vector<std::string>& words, const std::vector<std::string>& languages, Babylon::CancellationToken* token) {
         // Convert input text to tensor
         std::vector<Ort::Value> input_tensors;
-        std::vector<int64_t> input_ids = text_tokenizer->operator()(text, language);
+        std::vector<int64_t> input_ids;
+        for (size_t i = 0; i < words.size(); i++) {
+            std::vector<int64_t> word_ids = text_tokenizer->operator()(words[i], languages[i]);
+            input_ids.insert(input_ids.end(), word_ids.begin(), word_ids.end());
+        }
 
-        std::vector<int64_t> input_shape = {1, static_cast<int64_t>(input_ids.size())};
+        int64_t batch_size = words.size();
+        std::vector<int64_t> input_shape = {batch_size, static_cast<int64_t>(input_ids.size()) / batch_size};
         Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
 
         // Create input tensor
@@ -301,14 +524,16 @@ namespace DeepPhonemizer {
             input_shape.size()
         ));
 
-        // Run the model
-        std::vector<Ort::Value> output_tensors = session->Run(
-            Ort::RunOptions{nullptr}, 
+        // Run the model, holding the session keeps an idle release from freeing it mid-run
+        std::shared_ptr<Ort::Session> session = model->acquire();
+        std::vector<Ort::Value> output_tensors = Babylon::run(
+            session.get(), 
             input_names.data(), 
             input_tensors.data(), 
             input_names.size(), 
             output_names.data(), 
-            output_names.size()
+            output_names.size(),
+            token
         );
 
         // Check if output tensor is valid
@@ -320,21 +545,25 @@ namespace DeepPhonemizer {
         const float* output_data = output_tensors.front().GetTensorData<float>();
         std::vector<int64_t> output_shape = output_tensors.front().GetTensorTypeAndShapeInfo().GetShape();
 
-        // Ensure the output shape is as expected: {1, 50, 53}
-        if (output_shape.size() != 3 || output_shape[0] != 1 || output_shape[1] != 50 || output_shape[2] != 82) {
+        // Ensure the output shape is as expected: {batch, 50, 82}
+        if (output_shape.size() != 3 || output_shape[0] != batch_size || output_shape[1] != 50 || output_shape[2] != 82) {
             throw std::runtime_error("Unexpected output shape from the model.");
         }
 
         // Decode the output: find the index with the highest probability at each position
-        std::vector<int64_t> output_ids_vector(output_shape[1]);
-        for (size_t i = 0; i < output_shape[1]; ++i) {
-            std::vector<float> logits(output_data + i * output_shape[2], output_data + (i + 1) * output_shape[2]);
-            std::vector<float> probabilities = softmax(logits);
+        std::vector<std::vector<int64_t>> output_ids(batch_size, std::vector<int64_t>(output_shape[1]));
+        for (int64_t b = 0; b < batch_size; ++b) {
+            const float* batch_data = output_data + b * output_shape[1] * output_shape[2];
+
+            for (size_t i = 0; i < output_shape[1]; ++i) {
+                std::vector<float> logits(batch_data + i * output_shape[2], batch_data + (i + 1) * output_shape[2]);
+                std::vector<float> probabilities = softmax(logits);
 
-            auto max_prob_iter = std::max_element(probabilities.begin(), probabilities.end());
-            output_ids_vector[i] = std::distance(probabilities.begin(), max_prob_iter);
+                auto max_prob_iter = std::max_element(probabilities.begin(), probabilities.end());
+                output_ids[b][i] = std::distance(probabilities.begin(), max_prob_iter);
+            }
         }
 
-        return output_ids_vector;
+        return output_ids;
     }
 }
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "babylon.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace Babylon {
+    ThreadPool::ThreadPool(size_t threads, bool pin) : stopping(false) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        for (size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this, i, pin] {
+                if (pin) {
+                    pin_thread(i);
+                }
+                work();
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+
+        // Workers drain the queue before exiting so every task gets to run (or observe its cancellation)
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void ThreadPool::enqueue(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping) {
+                throw std::runtime_error("Thread pool is shutting down.");
+            }
+            tasks.push_back(std::move(task));
+        }
+        condition.notify_one();
+    }
+
+    size_t ThreadPool::queue_depth() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return tasks.size();
+    }
+
+    size_t ThreadPool::size() const {
+        return workers.size();
+    }
+
+    void ThreadPool::work() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+                if (tasks.empty()) {
+                    return;
+                }
+
+                task = std::move(tasks.front());
+                tasks.pop_front();
+            }
+
+            task();
+        }
+    }
+}
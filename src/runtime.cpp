@@ -0,0 +1,312 @@
+#include "babylon.h"
+
+#include <algorithm>
+#include <fstream>
+
+#ifdef _WIN32
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach/mach.h>
+#endif
+
+static bool ends_with(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Handles with an idle timeout, checked by one detached thread that runs while any are registered.
+// The state is never destroyed, so sessions still loaded at exit do not race static destructors.
+struct IdleWatcher {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::vector<Babylon::ModelHandle*> handles;
+    bool running = false;
+};
+
+static IdleWatcher& idle_watcher() {
+    static IdleWatcher* watcher = new IdleWatcher();
+    return *watcher;
+}
+
+static void release_idle_models() {
+    IdleWatcher& watcher = idle_watcher();
+    std::unique_lock<std::mutex> lock(watcher.mutex);
+
+    while (!watcher.handles.empty()) {
+        watcher.condition.wait_for(lock, std::chrono::milliseconds(250));
+
+        // Handles unregister under the same lock, so none is destroyed while it is being released
+        for (Babylon::ModelHandle* handle : watcher.handles) {
+            handle->release_if_idle();
+        }
+    }
+
+    watcher.running = false;
+}
+
+static void watch_idle(Babylon::ModelHandle* handle) {
+    IdleWatcher& watcher = idle_watcher();
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+
+    watcher.handles.push_back(handle);
+
+    if (!watcher.running) {
+        watcher.running = true;
+        std::thread(release_idle_models).detach();
+    }
+}
+
+static void unwatch_idle(Babylon::ModelHandle* handle) {
+    IdleWatcher& watcher = idle_watcher();
+    std::lock_guard<std::mutex> lock(watcher.mutex);
+
+    watcher.handles.erase(std::remove(watcher.handles.begin(), watcher.handles.end(), handle), watcher.handles.end());
+}
+
+namespace Babylon {
+    MappedFile::MappedFile(const std::string& path) : data(nullptr), size(0) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Failed to open model file: " + path);
+        }
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file, &file_size);
+        size = static_cast<size_t>(file_size.QuadPart);
+
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr) {
+            throw std::runtime_error("Failed to map model file: " + path);
+        }
+
+        data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (data == nullptr) {
+            throw std::runtime_error("Failed to map model file: " + path);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open model file: " + path);
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0) {
+            close(fd);
+            throw std::runtime_error("Failed to stat model file: " + path);
+        }
+        size = static_cast<size_t>(file_stat.st_size);
+
+        // Read-only shared mapping: every process mapping the file is backed by the same page cache
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED) {
+            throw std::runtime_error("Failed to map model file: " + path);
+        }
+        data = mapped;
+#endif
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(data, size);
+#endif
+    }
+
+    const void* MappedFile::get_data() const {
+        return data;
+    }
+
+    size_t MappedFile::get_size() const {
+        return size;
+    }
+
+    Ort::Session* load_session(const Ort::Env& env, const std::string& model_path, Ort::SessionOptions& session_options, const ModelOptions& options, MappedFile** mapping) {
+        *mapping = nullptr;
+
+        if (!options.shared_weights) {
+            return new Ort::Session(env, (const ORTCHAR_T *) model_path.c_str(), session_options);
+        }
+
+        // Only ORT format models can keep their initializers in the caller's buffer
+        if (!ends_with(model_path, ".ort")) {
+            throw std::invalid_argument("Shared weights need a model converted to ORT format (.ort): " + model_path);
+        }
+
+        session_options.AddConfigEntry("session.use_ort_model_bytes_directly", "1");
+        session_options.AddConfigEntry("session.use_ort_model_bytes_for_initializers", "1");
+
+        // Pre-packing copies weights into private buffers, which would defeat the sharing
+        session_options.AddConfigEntry("session.disable_prepacking", "1");
+
+        MappedFile* model_file = new MappedFile(model_path);
+        try {
+            Ort::Session* session = new Ort::Session(env, model_file->get_data(), model_file->get_size(), session_options);
+            *mapping = model_file;
+            return session;
+        }
+        catch (...) {
+            delete model_file;
+            throw;
+        }
+    }
+
+    ModelHandle::ModelHandle(const std::string& model_path, const Ort::SessionOptions& session_options, const ModelOptions& options)
+        : model_path(model_path), session_options(session_options.Clone()), options(options), resident_bytes(0), load_count(0) {
+        if (options.idle_timeout.count() > 0) {
+            watch_idle(this);
+        }
+    }
+
+    ModelHandle::~ModelHandle() {
+        unwatch_idle(this);
+    }
+
+    std::shared_ptr<Ort::Session> ModelHandle::acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        last_used = std::chrono::steady_clock::now();
+
+        if (session != nullptr) {
+            return session;
+        }
+
+        // Concurrent first uses wait here for one load instead of each loading a copy
+        size_t before = Babylon::resident_bytes();
+
+        Ort::SessionOptions load_options = session_options.Clone();
+        MappedFile* mapping = nullptr;
+        Ort::Session* loaded = load_session(get_env(), model_path, load_options, options, &mapping);
+
+        session = std::shared_ptr<Ort::Session>(loaded, [mapping](Ort::Session* session) {
+            delete session;
+            delete mapping;
+        });
+
+        size_t after = Babylon::resident_bytes();
+        resident_bytes = after > before ? after - before : 0;
+        load_count++;
+
+        return session;
+    }
+
+    void ModelHandle::release() {
+        std::function<void()> callback;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            session.reset();
+            resident_bytes = 0;
+            callback = on_release;
+        }
+
+        if (callback) {
+            callback();
+        }
+    }
+
+    bool ModelHandle::release_if_idle() {
+        std::function<void()> callback;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // A session still held by a run counts as in use however long the run takes. The check and the
+            // reset share the lock, a model acquired in between would otherwise be released as it starts to run.
+            if (session == nullptr || session.use_count() > 1 || std::chrono::steady_clock::now() - last_used < options.idle_timeout) {
+                return false;
+            }
+
+            session.reset();
+            resident_bytes = 0;
+            callback = on_release;
+        }
+
+        if (callback) {
+            callback();
+        }
+
+        return true;
+    }
+
+    bool ModelHandle::is_loaded() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return session != nullptr;
+    }
+
+    void ModelHandle::set_on_release(std::function<void()> callback) {
+        std::lock_guard<std::mutex> lock(mutex);
+        on_release = std::move(callback);
+    }
+
+    size_t ModelHandle::get_resident_bytes() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return resident_bytes;
+    }
+
+    size_t ModelHandle::get_load_count() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return load_count;
+    }
+
+    size_t resident_bytes() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return counters.WorkingSetSize;
+        }
+#elif defined(__APPLE__)
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) == KERN_SUCCESS) {
+            return info.resident_size;
+        }
+#else
+        // Linux and Android: the second field is the resident page count
+        std::ifstream statm("/proc/self/statm");
+        size_t total_pages = 0;
+        size_t resident_pages = 0;
+        if (statm >> total_pages >> resident_pages) {
+            return resident_pages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        }
+#endif
+        return 0;
+    }
+
+    std::string lookup_metadata(const Ort::ModelMetadata& model_metadata, const char* key, const std::string& fallback) {
+        Ort::AllocatorWithDefaultOptions allocator;
+        Ort::AllocatedStringPtr value = model_metadata.LookupCustomMetadataMapAllocated(key, allocator);
+
+        if (value == nullptr) {
+            return fallback;
+        }
+
+        return value.get();
+    }
+
+    std::string detect_quantization(Ort::Session* session) {
+        std::string quantization = lookup_metadata(session->GetModelMetadata(), "quantization", "fp32");
+
+        if (quantization != "fp32" && quantization != "fp16" && quantization != "int8_dynamic" && quantization != "int8_static") {
+            throw std::runtime_error("Unknown model quantization: " + quantization);
+        }
+
+        // FP16 exports must keep float32 outputs, the sessions read the output tensor as float
+        if (session->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetElementType() != ONNX_TENSOR_ELEMENT_DATA_TYPE_FLOAT) {
+            throw std::runtime_error("Model output must be float32, re-export it with keep_io_types.");
+        }
+
+        return quantization;
+    }
+}
@@ -0,0 +1,63 @@
+#include "babylon.h"
+#include <algorithm>
+#include <cctype>
+
+static bool is_space(char c) {
+    return std::isspace(static_cast<unsigned char>(c)) != 0;
+}
+
+namespace DeepPhonemizer {
+    StreamingSession::StreamingSession(Session& session, const std::string& language)
+        : session(session), language(language.empty() ? session.get_language() : language) {
+        const auto& languages = session.get_languages();
+        if (std::find(languages.begin(), languages.end(), this->language) == languages.end()) {
+            throw std::runtime_error("Language not supported: " + this->language);
+        }
+    }
+
+    std::vector<std::string> StreamingSession::push(std::string_view fragment, Babylon::CancellationToken* token) {
+        // Words are only ever split at whitespace, so nothing before the last space in the new
+        // fragment can change and the text before it is final
+        size_t boundary = std::string_view::npos;
+        for (size_t i = fragment.size(); i > 0; i--) {
+            if (is_space(fragment[i - 1])) {
+                boundary = i;
+                break;
+            }
+        }
+
+        if (boundary == std::string_view::npos) {
+            pending.append(fragment);
+            return {};
+        }
+
+        std::string complete = pending;
+        complete.append(fragment.substr(0, boundary));
+        pending.assign(fragment.substr(boundary));
+
+        return phonemize(complete, token);
+    }
+
+    std::vector<std::string> StreamingSession::finish(Babylon::CancellationToken* token) {
+        std::string complete;
+        complete.swap(pending);
+
+        return phonemize(complete, token);
+    }
+
+    void StreamingSession::reset() {
+        pending.clear();
+    }
+
+    const std::string& StreamingSession::get_pending() const {
+        return pending;
+    }
+
+    std::vector<std::string> StreamingSession::phonemize(const std::string& text, Babylon::CancellationToken* token) {
+        if (std::all_of(text.begin(), text.end(), is_space)) {
+            return {};
+        }
+
+        return session.g2p(text, language, token);
+    }
+}
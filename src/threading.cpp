@@ -0,0 +1,191 @@
+#include "babylon.h"
+#include <fstream>
+#include <memory>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Options are fixed once the environment exists, ORT only reads them when it creates the global pools
+static std::mutex threading_mutex;
+static Babylon::ThreadingOptions threading_options;
+// Never destroyed, the detached idle watcher may still release a session while the process exits
+static Ort::Env* env = nullptr;
+
+// Processors this process may run on, which respects taskset and cgroup cpusets on Linux
+static std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+
+    if (cpus.empty()) {
+        for (unsigned int cpu = 0; cpu < std::max(1u, std::thread::hardware_concurrency()); cpu++) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+
+    return cpus;
+}
+
+static size_t host_cores() {
+    return allowed_cpus().size();
+}
+
+// Parses a sysfs cpulist such as "0-3,8-11" into processor ids
+static std::vector<int> parse_cpu_list(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream stream(list);
+    std::string range;
+
+    while (std::getline(stream, range, ',')) {
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+static std::vector<int> pinned_cpus(const Babylon::ThreadingOptions& options) {
+    if (options.numa_node < 0) {
+        return allowed_cpus();
+    }
+
+#ifdef __linux__
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(options.numa_node) + "/cpulist");
+    std::string list;
+    if (std::getline(cpulist, list) && !list.empty()) {
+        return parse_cpu_list(list);
+    }
+#endif
+
+    throw std::invalid_argument("NUMA node " + std::to_string(options.numa_node) + " not found.");
+}
+
+// ORT runs the first intra-op thread on the caller, so the affinity string covers the rest:
+// one ';' separated entry per pool thread with 1-based processor ids.
+static std::string affinity_string(const std::vector<int>& cpus, size_t threads) {
+    std::string affinity;
+
+    for (size_t i = 1; i < threads; i++) {
+        if (!affinity.empty()) {
+            affinity += ";";
+        }
+        affinity += std::to_string(cpus[i % cpus.size()] + 1);
+    }
+
+    return affinity;
+}
+
+static size_t core_count(const Babylon::ThreadingOptions& options) {
+    if (options.threads > 0) {
+        return options.threads;
+    }
+
+    return options.numa_node < 0 ? host_cores() : pinned_cpus(options).size();
+}
+
+static bool is_pinned(const Babylon::ThreadingOptions& options) {
+    return options.pin_threads || options.numa_node >= 0;
+}
+
+static size_t pool_threads(const Babylon::ThreadingOptions& options) {
+    return options.mode == Babylon::ThreadingMode::THROUGHPUT ? 1 : core_count(options);
+}
+
+namespace Babylon {
+    void configure_threading(const ThreadingOptions& options) {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+
+        if (env != nullptr) {
+            throw std::logic_error("Threading must be configured before the first session is created.");
+        }
+
+        // Resolve the cores here, pool workers pin themselves and an exception there would terminate
+        if (is_pinned(options) && pinned_cpus(options).empty()) {
+            throw std::invalid_argument("No cores to pin the threads to.");
+        }
+
+        threading_options = options;
+    }
+
+    ThreadingOptions get_threading() {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+        return threading_options;
+    }
+
+    size_t intra_op_threads() {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+        return pool_threads(threading_options);
+    }
+
+    size_t request_parallelism() {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+        return threading_options.mode == ThreadingMode::LATENCY ? 1 : core_count(threading_options);
+    }
+
+    bool pin_request_threads() {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+        return threading_options.mode == ThreadingMode::THROUGHPUT && is_pinned(threading_options);
+    }
+
+    void pin_thread(size_t index) {
+#ifdef __linux__
+        std::vector<int> cpus = pinned_cpus(get_threading());
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[index % cpus.size()], &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void) index;
+#endif
+    }
+
+    const Ort::Env& get_env() {
+        std::lock_guard<std::mutex> lock(threading_mutex);
+
+        if (env != nullptr) {
+            return *env;
+        }
+
+        size_t threads = pool_threads(threading_options);
+
+        Ort::ThreadingOptions options;
+        options.SetGlobalIntraOpNumThreads(static_cast<int>(threads));
+        options.SetGlobalInterOpNumThreads(1);
+
+        // Spinning trades a core for wake-up latency, which only pays off when one run owns the pool
+        options.SetGlobalSpinControl(threading_options.mode == ThreadingMode::LATENCY ? 1 : 0);
+
+        if (is_pinned(threading_options) && threads > 1) {
+            std::string affinity = affinity_string(pinned_cpus(threading_options), threads);
+            Ort::ThrowOnError(Ort::GetApi().SetGlobalIntraOpThreadAffinity(options, affinity.c_str()));
+        }
+
+        env = new Ort::Env(options, ORT_LOGGING_LEVEL_WARNING, "Babylon");
+        env->DisableTelemetryEvents();
+
+        return *env;
+    }
+
+    void use_global_threads(Ort::SessionOptions& session_options) {
+        session_options.DisablePerSessionThreads();
+    }
+}
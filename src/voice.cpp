@@ -1,39 +1,41 @@
 #include "babylon.h"
 #include <onnxruntime_cxx_api.h>
 #include <string>
-#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cmath>
+#include <deque>
+#include <future>
 
 const std::array<const char *, 3> input_names = {"input", "input_lengths", "scales"};
-const std::array<const char *, 1> output_names = {"output"};
-
-struct WavHeader {
-  uint8_t RIFF[4] = {'R', 'I', 'F', 'F'};
-  uint32_t chunk_size;
-  uint8_t WAVE[4] = {'W', 'A', 'V', 'E'};
-
-  // fmt
-  uint8_t fmt[4] = {'f', 'm', 't', ' '};
-  uint32_t fmt_size = 16;       // bytes
-  uint16_t audio_format = 1;    // PCM
-  uint16_t num_channels;        // mono
-  uint32_t sample_rate;         // Hertz
-  uint32_t bytes_per_second;    // sample_rate * sample_width
-  uint16_t block_align = 2;     // 16-bit mono
-  uint16_t bits_per_sample = 16;
-
-  // data
-  uint8_t data[4] = {'d', 'a', 't', 'a'};
-  uint32_t data_size;
-};
 
-namespace Vits {
-    const float FMIN = static_cast<float>(std::numeric_limits<int16_t>::min());
-    const float FMAX = static_cast<float>(std::numeric_limits<int16_t>::max());
+// Split models cache the latents of recently spoken phrases, prompts and fillers repeat often
+const size_t ENCODER_CACHE_SIZE = 64;
+
+// Streamed audio cannot be normalized up front, so the gain assumes at least this peak and only
+// drops when a louder window arrives
+const float STREAM_PEAK_FLOOR = 0.5f;
+
+static std::string output_name_of(const std::shared_ptr<Ort::Session>& session) {
+    Ort::AllocatorWithDefaultOptions allocator;
+    return session->GetOutputNameAllocated(0, allocator).get();
+}
 
+// The decoder sits next to the encoder and shares its format
+static std::string decoder_path(const std::string& model_path, std::string decoder) {
+    size_t separator = model_path.find_last_of("/\\");
+    std::string directory = separator == std::string::npos ? "" : model_path.substr(0, separator + 1);
+
+    size_t extension = decoder.rfind('.');
+    if (model_path.size() > 4 && model_path.compare(model_path.size() - 4, 4, ".ort") == 0 && extension != std::string::npos) {
+        decoder = decoder.substr(0, extension) + ".ort";
+    }
+
+    return directory + decoder;
+}
+
+namespace Vits {
     SequenceTokenizer::SequenceTokenizer(const std::vector<std::string>& phonemes, const std::vector<int>& phoneme_ids) {
         if (phonemes.size() != phoneme_ids.size()) {
             throw std::invalid_argument("Phonemes and phoneme IDs must have the same length.");
@@ -62,17 +64,17 @@ namespace Vits {
         return phoneme_ids;
     }
 
-    Session::Session(const std::string& model_path) {
-        Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "VITS");
-        env.DisableTelemetryEvents();
-
+    Session::Session(const std::string& model_path, const Babylon::ModelOptions& options) {
         Ort::SessionOptions session_options;
+        Babylon::use_global_threads(session_options);
         session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_DISABLE_ALL);
         session_options.DisableCpuMemArena();
         session_options.DisableMemPattern();
         session_options.DisableProfiling();
 
-        session = new Ort::Session(env, (const ORTCHAR_T *) model_path.c_str(), session_options);
+        model = std::make_unique<Babylon::ModelHandle>(model_path, session_options, options);
+        std::shared_ptr<Ort::Session> session = model->acquire();
+        quantization = Babylon::detect_quantization(session.get());
 
         // Load metadata from the model
         Ort::ModelMetadata model_metadata = session->GetModelMetadata();
@@ -113,24 +115,57 @@ namespace Vits {
         scales = {noise_scale, length_scale, noise_w};
 
         phoneme_tokenizer = new SequenceTokenizer(phonemes, phoneme_ids);
+        output_name = output_name_of(session);
+
+        // Split models name their vocoder, which turns the encoder latent into audio
+        std::string decoder_name = Babylon::lookup_metadata(model_metadata, "decoder", "");
+        if (!decoder_name.empty()) {
+            hop_length = std::stoll(Babylon::lookup_metadata(model_metadata, "hop_length", "256"));
+            decoder_window = std::stoll(Babylon::lookup_metadata(model_metadata, "decoder_window", "32"));
+            decoder_overlap = std::stoll(Babylon::lookup_metadata(model_metadata, "decoder_overlap", "8"));
+
+            if (hop_length <= 0 || decoder_window <= 0 || decoder_overlap < 0) {
+                throw std::runtime_error("Invalid decoder window in model metadata.");
+            }
+
+            decoder = std::make_unique<Babylon::ModelHandle>(decoder_path(model_path, decoder_name), session_options, options);
+            std::shared_ptr<Ort::Session> decoder_session = decoder->acquire();
+
+            Ort::AllocatorWithDefaultOptions name_allocator;
+            decoder_input_name = decoder_session->GetInputNameAllocated(0, name_allocator).get();
+            decoder_output_name = output_name_of(decoder_session);
+        }
+
+        // Cached latents are only worth their memory while the model is in use
+        model->set_on_release([this] {
+            clear_encoder_cache();
+        });
+
+        if (options.lazy_load) {
+            session.reset();
+            unload();
+        }
     }
 
     Session::~Session() {
-        delete session;
+        // Before the members its release callback clears, the idle watcher may be releasing it right now
+        model.reset();
+        decoder.reset();
         delete phoneme_tokenizer;
     }
 
-    void Session::tts(const std::vector<std::string>& phonemes, const std::string& output_path) {
+    Ort::Value Session::infer(const std::vector<int64_t>& phoneme_ids, Babylon::CancellationToken* token) {
         Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
 
         std::vector<Ort::Value> input_tensors;
 
-        std::vector<int64_t> phoneme_ids = phoneme_tokenizer->operator()(phonemes);
+        // ORT only reads the inputs, the const cast lets them wrap the caller's IDs without a copy
+        int64_t* ids = const_cast<int64_t*>(phoneme_ids.data());
 
         std::vector<int64_t> phoneme_ids_shape = {1, (int64_t) phoneme_ids.size()};
         input_tensors.push_back(Ort::Value::CreateTensor<int64_t>(
             memory_info, 
-            phoneme_ids.data(), 
+            ids, 
             phoneme_ids.size(), 
             phoneme_ids_shape.data(),
             phoneme_ids_shape.size()
@@ -155,13 +190,16 @@ namespace Vits {
             scales_shape.size()
         ));
 
-        std::vector<Ort::Value> output_tensors = session->Run(
-            Ort::RunOptions{nullptr}, 
+        const char* output_names[] = {output_name.c_str()};
+        std::shared_ptr<Ort::Session> session = model->acquire();
+        std::vector<Ort::Value> output_tensors = Babylon::run(
+            session.get(), 
             input_names.data(), 
             input_tensors.data(), 
             input_names.size(), 
-            output_names.data(), 
-            output_names.size()
+            output_names, 
+            1,
+            token
         );
 
         // Check if output tensor is valid
@@ -169,45 +207,340 @@ namespace Vits {
             throw std::runtime_error("No output tensor returned from the model.");
         }
 
-        const float *output_data = output_tensors.front().GetTensorData<float>();
-        std::vector<int64_t> output_shape = output_tensors.front().GetTensorTypeAndShapeInfo().GetShape();
+        return std::move(output_tensors.front());
+    }
+
+    std::shared_ptr<const Session::Latent> Session::encode(const std::vector<std::string>& phonemes, Babylon::CancellationToken* token) {
+        std::vector<int64_t> phoneme_ids = phoneme_tokenizer->operator()(phonemes);
+        std::string key(reinterpret_cast<const char*>(phoneme_ids.data()), phoneme_ids.size() * sizeof(int64_t));
+
+        {
+            std::lock_guard<std::mutex> lock(encoder_cache_mutex);
+            auto cached = encoder_cache_index.find(key);
+            if (cached != encoder_cache_index.end()) {
+                encoder_cache.splice(encoder_cache.begin(), encoder_cache, cached->second);
+                return cached->second->second;
+            }
+        }
+
+        // A cached latent keeps the noise drawn the first time, so a repeated phrase sounds the same
+        Ort::Value value = infer(phoneme_ids, token);
+        std::vector<int64_t> shape = value.GetTensorTypeAndShapeInfo().GetShape();
+        if (shape.size() != 3) {
+            throw std::runtime_error("Encoder output must be [batch, channels, frames].");
+        }
+
+        auto latent = std::make_shared<const Latent>(Latent{std::move(value), shape[1], shape[2]});
+
+        std::lock_guard<std::mutex> lock(encoder_cache_mutex);
+        if (encoder_cache_index.find(key) == encoder_cache_index.end()) {
+            encoder_cache.emplace_front(key, latent);
+            encoder_cache_index[key] = encoder_cache.begin();
+
+            if (encoder_cache.size() > ENCODER_CACHE_SIZE) {
+                encoder_cache_index.erase(encoder_cache.back().first);
+                encoder_cache.pop_back();
+            }
+        }
+
+        return latent;
+    }
+
+    Ort::Value Session::decode(const Latent& latent, int64_t start, int64_t end, Babylon::CancellationToken* token) {
+        Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+        // Copy the frame range of every channel into a contiguous [1, channels, frames] window
+        int64_t frames = end - start;
+        const float* latent_data = latent.value.GetTensorData<float>();
+        std::vector<float> window(latent.channels * frames);
+        for (int64_t channel = 0; channel < latent.channels; channel++) {
+            const float* row = latent_data + channel * latent.frames + start;
+            std::copy(row, row + frames, window.begin() + channel * frames);
+        }
+
+        std::vector<int64_t> window_shape = {1, latent.channels, frames};
+        Ort::Value input = Ort::Value::CreateTensor<float>(
+            memory_info,
+            window.data(),
+            window.size(),
+            window_shape.data(),
+            window_shape.size()
+        );
+
+        const char* decoder_input_names[] = {decoder_input_name.c_str()};
+        const char* decoder_output_names[] = {decoder_output_name.c_str()};
+        std::shared_ptr<Ort::Session> session = decoder->acquire();
+        std::vector<Ort::Value> output_tensors = Babylon::run(session.get(), decoder_input_names, &input, 1, decoder_output_names, 1, token);
+
+        if (output_tensors.empty()) {
+            throw std::runtime_error("No output tensor returned from the decoder.");
+        }
+
+        return std::move(output_tensors.front());
+    }
+
+    Ort::Value Session::decode_window(const Latent& latent, int64_t start, int64_t& offset, int64_t& count, Babylon::CancellationToken* token) {
+        int64_t end = std::min(start + decoder_window, latent.frames);
+
+        // Decode with context on both sides so the window edges match a full decode, then keep the middle
+        int64_t context_start = std::max<int64_t>(start - decoder_overlap, 0);
+        int64_t context_end = std::min(end + decoder_overlap, latent.frames);
+
+        Ort::Value output = decode(latent, context_start, context_end, token);
+        std::vector<int64_t> output_shape = output.GetTensorTypeAndShapeInfo().GetShape();
         int64_t output_count = output_shape[output_shape.size() - 1];
 
+        offset = std::min((start - context_start) * hop_length, output_count);
+        count = std::min((end - start) * hop_length, output_count - offset);
+
+        return output;
+    }
+
+    void Session::stream(const Latent& latent, float& stream_peak, int64_t fade, Babylon::AudioWriter& writer, Babylon::CancellationToken* token) {
+        for (int64_t start = 0; start < latent.frames; start += decoder_window) {
+            int64_t offset, count;
+            Ort::Value output = decode_window(latent, start, offset, count, token);
+            const float* audio = output.GetTensorData<float>() + offset;
+
+            // A louder window lowers the gain, glide down to it before the first sample that would clip
+            // at the old gain instead of stepping at the window edge
+            float gain = 1.0f / stream_peak;
+            int64_t ramp = 0;
+            float window_peak = peak(audio, count);
+            if (window_peak > stream_peak) {
+                while (ramp < count && std::abs(audio[ramp]) <= stream_peak) {
+                    ramp++;
+                }
+                stream_peak = window_peak;
+            }
+
+            bool last = start + decoder_window >= latent.frames;
+            write(audio, count, 1.0f / stream_peak, start == 0 ? fade : 0, last ? fade : 0, writer, token, ramp, gain);
+        }
+    }
+
+    float Session::decoder_error(const std::vector<std::string>& phonemes, Babylon::CancellationToken* token) {
+        if (!is_split()) {
+            throw std::logic_error("Only split models decode in windows.");
+        }
+
+        std::shared_ptr<const Latent> latent = encode(phonemes, token);
+
+        Ort::Value full = decode(*latent, 0, latent->frames, token);
+        const float* full_data = full.GetTensorData<float>();
+        std::vector<int64_t> full_shape = full.GetTensorTypeAndShapeInfo().GetShape();
+        int64_t full_count = full_shape[full_shape.size() - 1];
+
+        float error = 0.0f;
+        int64_t position = 0;
+        for (int64_t start = 0; start < latent->frames; start += decoder_window) {
+            int64_t offset, count;
+            Ort::Value output = decode_window(*latent, start, offset, count, token);
+            const float* audio = output.GetTensorData<float>() + offset;
+
+            for (int64_t i = 0; i < count && position + i < full_count; i++) {
+                error = std::max(error, std::abs(audio[i] - full_data[position + i]));
+            }
+            position += count;
+        }
+
+        // A window that came out shorter than the full decode is as wrong as one that differs
+        if (position != full_count) {
+            return 1.0f;
+        }
+
+        return error / peak(full_data, full_count);
+    }
+
+    float Session::peak(const float* audio, int64_t count) const {
         // Get max audio value for scaling
         float max_output_value = 0.01f;
-        for (int64_t i = 0; i < output_count; i++) {
-          float output_value = abs(output_data[i]);
+        for (int64_t i = 0; i < count; i++) {
+          float output_value = abs(audio[i]);
           if (output_value > max_output_value) {
             max_output_value = output_value;
           }
         }
 
-        std::vector<int16_t> audio_data;
-        audio_data.reserve(output_count);
+        return max_output_value;
+    }
+
+    void Session::write(const float* audio, int64_t count, float gain, int64_t fade_in, int64_t fade_out, Babylon::AudioWriter& writer, Babylon::CancellationToken* token, int64_t ramp, float ramp_gain) const {
+        fade_in = std::min(fade_in, count / 2);
+        fade_out = std::min(fade_out, count / 2);
+        ramp = std::min(ramp, count - fade_out);
+
+        // Ramp the edges so joined segments do not click, and the first ramp samples from ramp_gain to gain
+        int64_t head = std::max(fade_in, ramp);
+        for (int64_t i = 0; i < head; i++) {
+            float sample_gain = i < ramp ? ramp_gain + (gain - ramp_gain) * i / ramp : gain;
+            if (i < fade_in) {
+                sample_gain *= static_cast<float>(i) / fade_in;
+            }
+            writer.write(audio + i, 1, sample_gain);
+        }
+
+        const int64_t chunk = 1 << 14;
+        for (int64_t offset = head; offset < count - fade_out; offset += chunk) {
+            if (token != nullptr) {
+                token->check();
+            }
+
+            writer.write(audio + offset, std::min(chunk, count - fade_out - offset), gain);
+        }
+
+        for (int64_t i = count - fade_out; i < count; i++) {
+            float ramp = static_cast<float>(count - 1 - i) / fade_out;
+            writer.write(audio + i, 1, gain * ramp);
+        }
+    }
+
+    void Session::tts(const std::vector<std::string>& phonemes, Babylon::AudioWriter& writer, Babylon::CancellationToken* token) {
+        if (writer.get_sample_rate() != sample_rate) {
+            throw std::invalid_argument("Audio writer sample rate does not match the model.");
+        }
+
+        if (is_split()) {
+            float stream_peak = STREAM_PEAK_FLOOR;
+            stream(*encode(phonemes, token), stream_peak, 0, writer, token);
+            return;
+        }
+
+        Ort::Value output = infer(phoneme_tokenizer->operator()(phonemes), token);
+
+        const float *output_data = output.GetTensorData<float>();
+        std::vector<int64_t> output_shape = output.GetTensorTypeAndShapeInfo().GetShape();
+        int64_t output_count = output_shape[output_shape.size() - 1];
+
+        // Scale audio to fill range, the writer converts it to the output sample format
+        write(output_data, output_count, 1.0f / peak(output_data, output_count), 0, 0, writer, token);
+    }
+
+    void Session::tts(const std::vector<std::vector<std::string>>& segments, const std::vector<float>& pauses, Babylon::AudioWriter& writer, Babylon::CancellationToken* token, size_t parallelism) {
+        if (writer.get_sample_rate() != sample_rate) {
+            throw std::invalid_argument("Audio writer sample rate does not match the model.");
+        }
+
+        if (segments.size() != pauses.size()) {
+            throw std::invalid_argument("Every segment needs a pause.");
+        }
+
+        const int64_t fade = sample_rate / 200; // 5 ms
+
+        // Split models only run the encoders ahead, each latent is then decoded window by window as it is written
+        if (is_split()) {
+            auto encode_segment = [this, token](const std::vector<std::string>& phonemes) {
+                return phonemes.empty() ? nullptr : encode(phonemes, token);
+            };
+
+            std::deque<std::future<std::shared_ptr<const Latent>>> in_flight;
+            size_t next = 0;
+            float stream_peak = STREAM_PEAK_FLOOR;
+
+            for (size_t i = 0; i < segments.size(); i++) {
+                while (next < segments.size() && in_flight.size() < std::max<size_t>(parallelism, 1)) {
+                    in_flight.push_back(std::async(std::launch::async, encode_segment, std::cref(segments[next])));
+                    next++;
+                }
+
+                std::shared_ptr<const Latent> latent = in_flight.front().get();
+                in_flight.pop_front();
+
+                if (latent != nullptr) {
+                    stream(*latent, stream_peak, fade, writer, token);
+                }
+
+                writer.write_silence(static_cast<size_t>(pauses[i] * sample_rate));
+            }
+
+            return;
+        }
+
+        auto synthesize = [this, token](const std::vector<std::string>& phonemes) {
+            if (phonemes.empty()) {
+                return std::vector<float>();
+            }
 
-        // Scale audio to fill range and convert to int16
-        float audio_scale = (32767.0f / std::max(0.01f, max_output_value));
-        for (int64_t i = 0; i < output_count; i++) {
-            float audio_value = output_data[i] * audio_scale;
-            float clamped_audio_value = std::clamp(audio_value, FMIN, FMAX);
-            int16_t int_audio_value = static_cast<int16_t>(clamped_audio_value);
-            audio_data.push_back(int_audio_value);
+            Ort::Value output = infer(phoneme_tokenizer->operator()(phonemes), token);
+            const float* output_data = output.GetTensorData<float>();
+            std::vector<int64_t> output_shape = output.GetTensorTypeAndShapeInfo().GetShape();
+
+            return std::vector<float>(output_data, output_data + output_shape[output_shape.size() - 1]);
+        };
+
+        // Segments run ahead in parallel but are written strictly in order
+        std::deque<std::future<std::vector<float>>> in_flight;
+        size_t next = 0;
+        float gain = 0.0f;
+
+        for (size_t i = 0; i < segments.size(); i++) {
+            while (next < segments.size() && in_flight.size() < std::max<size_t>(parallelism, 1)) {
+                in_flight.push_back(std::async(std::launch::async, synthesize, std::cref(segments[next])));
+                next++;
+            }
+
+            std::vector<float> audio = in_flight.front().get();
+            in_flight.pop_front();
+
+            // One gain for the whole stream keeps loudness steady, it only drops if a later segment would clip
+            if (!audio.empty()) {
+                float segment_gain = 1.0f / peak(audio.data(), audio.size());
+                gain = gain == 0.0f ? segment_gain : std::min(gain, segment_gain);
+
+                write(audio.data(), audio.size(), gain, fade, fade, writer, token);
+            }
+
+            writer.write_silence(static_cast<size_t>(pauses[i] * sample_rate));
         }
+    }
 
-        std::ofstream audio_file(output_path, std::ios::binary);
-        
-        int sample_width = 2;
-        int channels = 1;
+    void Session::tts(const std::vector<std::string>& phonemes, const std::string& output_path, Babylon::CancellationToken* token) {
+        Babylon::AudioWriter writer(output_path, sample_rate);
+        tts(phonemes, writer, token);
+        writer.close();
+    }
 
-        WavHeader header;
-        header.data_size = audio_data.size() * sample_width * channels;
-        header.chunk_size = header.data_size + sizeof(WavHeader) - 8;
-        header.sample_rate = sample_rate;
-        header.num_channels = channels;
-        header.bytes_per_second = sample_rate * sample_width * channels;
-        header.block_align = sample_width * channels;
+    int Session::get_sample_rate() const {
+        return sample_rate;
+    }
+
+    const std::string& Session::get_quantization() const {
+        return quantization;
+    }
+
+    bool Session::is_split() const {
+        return decoder != nullptr;
+    }
+
+    void Session::unload() {
+        model->release();
+        if (decoder != nullptr) {
+            decoder->release();
+        }
+    }
+
+    bool Session::is_loaded() const {
+        return model->is_loaded() || (decoder != nullptr && decoder->is_loaded());
+    }
+
+    size_t Session::get_model_bytes() const {
+        return model->get_resident_bytes() + (decoder != nullptr ? decoder->get_resident_bytes() : 0);
+    }
+
+    size_t Session::get_cache_bytes() const {
+        std::lock_guard<std::mutex> lock(encoder_cache_mutex);
+
+        size_t bytes = 0;
+        for (const auto& entry : encoder_cache) {
+            bytes += entry.first.capacity() + entry.second->channels * entry.second->frames * sizeof(float);
+        }
+
+        return bytes;
+    }
 
-        audio_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
-        audio_file.write((const char *) audio_data.data(), sizeof(int16_t) * audio_data.size());
+    void Session::clear_encoder_cache() {
+        std::lock_guard<std::mutex> lock(encoder_cache_mutex);
+        encoder_cache_index.clear();
+        encoder_cache.clear();
     }
 }
\ No newline at end of file
@@ -1,73 +1,356 @@
 import ctypes
 import os
+import queue
+import sys
+import threading
 
 current_dir = os.path.dirname(os.path.abspath(__file__))
 
 symbols = " abdefghijklmnoprstuvwxyzæçðøŋœɐɑɔəɛɜɹɡɪʁʃʊʌʏʒʔ'ˌː ̃ ̍ ̥ ̩ ̯ ͡θ.,:;?!\"()-"
 
 # Load the shared library
-if os.name == 'nt':  # Windows
+if sys.platform == 'win32':
     babylon_lib = ctypes.CDLL(os.path.join(current_dir, 'windows', 'libbabylon.dll'))
-elif os.name == 'posix':  # macOS
+elif sys.platform == 'darwin':
     babylon_lib = ctypes.CDLL(os.path.join(current_dir, 'macos', 'libbabylon.dylib'))
 else:  # Linux/Unix
     babylon_lib = ctypes.CDLL(os.path.join(current_dir, 'linux', 'libbabylon.so'))
 
+# ctypes.CDLL releases the GIL for the duration of every call below, so Python threads
+# calling into the library run in parallel.
+
+class G2POptions(ctypes.Structure):
+    _fields_ = [
+        ('language', ctypes.c_char_p),
+        ('use_dictionaries', ctypes.c_ubyte),
+        ('use_punctuation', ctypes.c_ubyte),
+        ('use_shared_weights', ctypes.c_ubyte),
+    ]
+
+class TTSOptions(ctypes.Structure):
+    _fields_ = [
+        ('use_shared_weights', ctypes.c_ubyte),
+    ]
+
+THREADING_LATENCY = 0
+THREADING_THROUGHPUT = 1
+
+class ThreadingOptions(ctypes.Structure):
+    _fields_ = [
+        ('mode', ctypes.c_int),
+        ('threads', ctypes.c_uint),
+        ('pin_threads', ctypes.c_ubyte),
+        ('numa_node', ctypes.c_int),
+    ]
+
+class MemoryOptions(ctypes.Structure):
+    _fields_ = [
+        ('lazy_load', ctypes.c_ubyte),
+        ('idle_timeout_ms', ctypes.c_uint),
+    ]
+
+class MemoryUsage(ctypes.Structure):
+    _fields_ = [
+        ('g2p_model', ctypes.c_size_t),
+        ('g2p_dictionaries', ctypes.c_size_t),
+        ('tts_model', ctypes.c_size_t),
+        ('tts_cache', ctypes.c_size_t),
+        ('process', ctypes.c_size_t),
+    ]
+
+class Audio(ctypes.Structure):
+    _fields_ = [
+        ('samples', ctypes.POINTER(ctypes.c_float)),
+        ('sample_count', ctypes.c_size_t),
+        ('sample_rate', ctypes.c_int),
+    ]
+
+AudioCallback = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.POINTER(ctypes.c_float), ctypes.c_size_t, ctypes.c_void_p)
+
 # Define the function prototypes
-babylon_lib.babylon_g2p_init.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int]
+babylon_lib.babylon_configure_threading.argtypes = [ThreadingOptions]
+babylon_lib.babylon_configure_threading.restype = ctypes.c_int
+
+babylon_lib.babylon_configure_memory.argtypes = [MemoryOptions]
+babylon_lib.babylon_configure_memory.restype = ctypes.c_int
+
+babylon_lib.babylon_memory_usage.argtypes = []
+babylon_lib.babylon_memory_usage.restype = MemoryUsage
+
+babylon_lib.babylon_unload.argtypes = []
+babylon_lib.babylon_unload.restype = None
+
+babylon_lib.babylon_g2p_init.argtypes = [ctypes.c_char_p, G2POptions]
 babylon_lib.babylon_g2p_init.restype = ctypes.c_int
 
-babylon_lib.babylon_g2p.argtypes = [ctypes.c_char_p]
-babylon_lib.babylon_g2p.restype = ctypes.c_char_p
+# Results are taken as raw pointers so they can be released with babylon_free
+babylon_lib.babylon_g2p_with_language.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+babylon_lib.babylon_g2p_with_language.restype = ctypes.c_void_p
+
+babylon_lib.babylon_g2p_tokens_with_language.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+babylon_lib.babylon_g2p_tokens_with_language.restype = ctypes.POINTER(ctypes.c_int)
+
+babylon_lib.babylon_g2p_batch.argtypes = [ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_char_p), ctypes.c_size_t]
+babylon_lib.babylon_g2p_batch.restype = ctypes.POINTER(ctypes.c_void_p)
+
+babylon_lib.babylon_g2p_batch_free.argtypes = [ctypes.POINTER(ctypes.c_void_p), ctypes.c_size_t]
+babylon_lib.babylon_g2p_batch_free.restype = None
+
+babylon_lib.babylon_g2p_stream_create.argtypes = [ctypes.c_char_p]
+babylon_lib.babylon_g2p_stream_create.restype = ctypes.c_void_p
+
+babylon_lib.babylon_g2p_stream_push.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+babylon_lib.babylon_g2p_stream_push.restype = ctypes.c_void_p
 
-babylon_lib.babylon_g2p_tokens.argtypes = [ctypes.c_char_p]
-babylon_lib.babylon_g2p_tokens.restype = ctypes.POINTER(ctypes.c_int)
+babylon_lib.babylon_g2p_stream_finish.argtypes = [ctypes.c_void_p]
+babylon_lib.babylon_g2p_stream_finish.restype = ctypes.c_void_p
+
+babylon_lib.babylon_g2p_stream_free.argtypes = [ctypes.c_void_p]
+babylon_lib.babylon_g2p_stream_free.restype = None
+
+babylon_lib.babylon_tokens_length.argtypes = [ctypes.POINTER(ctypes.c_int)]
+babylon_lib.babylon_tokens_length.restype = ctypes.c_size_t
+
+babylon_lib.babylon_g2p_lexicon_load.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
+babylon_lib.babylon_g2p_lexicon_load.restype = ctypes.c_int
+
+babylon_lib.babylon_g2p_lexicon_set.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p]
+babylon_lib.babylon_g2p_lexicon_set.restype = ctypes.c_int
+
+babylon_lib.babylon_g2p_set_dictionary_only.argtypes = [ctypes.c_int]
+babylon_lib.babylon_g2p_set_dictionary_only.restype = ctypes.c_int
+
+babylon_lib.babylon_free.argtypes = [ctypes.c_void_p]
+babylon_lib.babylon_free.restype = None
 
 babylon_lib.babylon_g2p_free.argtypes = []
 babylon_lib.babylon_g2p_free.restype = None
 
-babylon_lib.babylon_tts_init.argtypes = [ctypes.c_char_p]
-babylon_lib.babylon_tts_init.restype = ctypes.c_int
+babylon_lib.babylon_tts_init_with_options.argtypes = [ctypes.c_char_p, TTSOptions]
+babylon_lib.babylon_tts_init_with_options.restype = ctypes.c_int
 
 babylon_lib.babylon_tts.argtypes = [ctypes.c_char_p, ctypes.c_char_p]
 babylon_lib.babylon_tts.restype = None
 
+babylon_lib.babylon_tts_pcm.argtypes = [ctypes.c_char_p]
+babylon_lib.babylon_tts_pcm.restype = ctypes.POINTER(Audio)
+
+babylon_lib.babylon_tts_stream.argtypes = [ctypes.c_char_p, AudioCallback, ctypes.c_void_p]
+babylon_lib.babylon_tts_stream.restype = ctypes.c_int
+
+babylon_lib.babylon_audio_free.argtypes = [ctypes.POINTER(Audio)]
+babylon_lib.babylon_audio_free.restype = None
+
+babylon_lib.babylon_tts_sample_rate.argtypes = []
+babylon_lib.babylon_tts_sample_rate.restype = ctypes.c_int
+
 babylon_lib.babylon_tts_free.argtypes = []
 babylon_lib.babylon_tts_free.restype = None
 
+def _encode(text):
+    return None if text is None else text.encode('utf-8')
+
+# Owns a library buffer and exposes it to NumPy without a copy. Every array viewing it keeps
+# this object alive, the buffer is released once the last view is gone.
+class _LibraryBuffer:
+    def __init__(self, address, length, typestr, release):
+        self.__array_interface__ = {
+            'data': (address, True),
+            'shape': (length,),
+            'typestr': typestr,
+            'version': 3,
+        }
+        self._release = release
+
+    def __del__(self):
+        self._release()
+
+def _as_array(address, length, typestr, release):
+    import numpy as np
+
+    if length == 0:
+        release()
+        return np.empty(0, dtype=typestr)
+
+    return np.asarray(_LibraryBuffer(address, length, typestr, release))
+
+# Must be called before init_g2p and init_tts, mode is THREADING_LATENCY or THREADING_THROUGHPUT
+def configure_threading(mode=THREADING_LATENCY, threads=0, pin_threads=False, numa_node=-1):
+    return babylon_lib.babylon_configure_threading(ThreadingOptions(mode, threads, pin_threads, numa_node))
+
+# Applies to init_g2p and init_tts calls made afterwards
+def configure_memory(lazy_load=False, idle_timeout_ms=0):
+    return babylon_lib.babylon_configure_memory(MemoryOptions(lazy_load, idle_timeout_ms))
+
+# Resident bytes per component, models report 0 while released
+def memory_usage():
+    usage = babylon_lib.babylon_memory_usage()
+    return {name: getattr(usage, name) for name, _ in MemoryUsage._fields_}
+
+# Release both models now, the next call loads them again
+def unload():
+    babylon_lib.babylon_unload()
+
 # Initialize G2P
-def init_g2p(model_path, language, use_punctuation):
-    return babylon_lib.babylon_g2p_init(model_path.encode('utf-8'), language.encode('utf-8'), use_punctuation)
-
-# Use G2P
-def g2p(text):
-    result = babylon_lib.babylon_g2p(text.encode('utf-8'))
-    return result.decode('utf-8')
-
-# Use G2P with tokens
-def g2p_tokens(text):
-    result_ptr = babylon_lib.babylon_g2p_tokens(text.encode('utf-8'))
-    
-    # Convert the pointer to a Python list, stopping at -1
-    tokens = []
-    i = 0
-    while result_ptr[i] != -1:
-        tokens.append(result_ptr[i])
-        i += 1
-
-    return tokens
+def init_g2p(model_path, language='en_us', use_dictionaries=True, use_punctuation=False, use_shared_weights=False):
+    options = G2POptions(_encode(language), use_dictionaries, use_punctuation, use_shared_weights)
+    return babylon_lib.babylon_g2p_init(_encode(model_path), options)
+
+def _take_string(result):
+    if not result:
+        raise RuntimeError('G2P failed')
+
+    try:
+        return ctypes.string_at(result).decode('utf-8')
+    finally:
+        babylon_lib.babylon_free(result)
+
+# Use G2P, language defaults to the one given at init
+def g2p(text, language=None):
+    return _take_string(babylon_lib.babylon_g2p_with_language(_encode(text), _encode(language)))
+
+# Incremental G2P for text arriving in fragments, push returns the phonemes of completed words
+class G2PStream:
+    def __init__(self, language=None):
+        self._stream = babylon_lib.babylon_g2p_stream_create(_encode(language))
+        if not self._stream:
+            raise RuntimeError('Failed to create G2P stream')
+
+    def push(self, fragment):
+        return _take_string(babylon_lib.babylon_g2p_stream_push(self._stream, _encode(fragment)))
+
+    def finish(self):
+        return _take_string(babylon_lib.babylon_g2p_stream_finish(self._stream))
+
+    def close(self):
+        if self._stream:
+            babylon_lib.babylon_g2p_stream_free(self._stream)
+            self._stream = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def __del__(self):
+        self.close()
+
+# Use G2P with tokens, returns a read-only int32 NumPy array viewing the library's buffer
+def g2p_tokens(text, language=None):
+    result = babylon_lib.babylon_g2p_tokens_with_language(_encode(text), _encode(language))
+    if not result:
+        raise RuntimeError('G2P failed')
+
+    length = babylon_lib.babylon_tokens_length(result)
+    address = ctypes.cast(result, ctypes.c_void_p).value
+    return _as_array(address, length, '<i4', lambda: babylon_lib.babylon_free(address))
+
+# Phonemizes all texts in one batched model call
+def g2p_batch(texts, languages=None):
+    count = len(texts)
+    text_array = (ctypes.c_char_p * count)(*[_encode(text) for text in texts])
+    language_array = None if languages is None else (ctypes.c_char_p * count)(*[_encode(language) for language in languages])
+
+    results = babylon_lib.babylon_g2p_batch(text_array, language_array, count)
+    if not results:
+        raise RuntimeError('G2P failed')
+
+    try:
+        return [ctypes.string_at(results[i]).decode('utf-8') for i in range(count)]
+    finally:
+        babylon_lib.babylon_g2p_batch_free(results, count)
+
+# Pronunciation overrides, consulted before the model dictionaries and reloadable at any time
+def load_lexicon(path, language=None):
+    if babylon_lib.babylon_g2p_lexicon_load(_encode(path), _encode(language)) != 0:
+        raise RuntimeError(f'Failed to load lexicon {path}')
+
+def set_pronunciation(word, phonemes, language=None):
+    if not isinstance(phonemes, str):
+        phonemes = ' '.join(phonemes)
+    if babylon_lib.babylon_g2p_lexicon_set(_encode(word), _encode(phonemes), _encode(language)) != 0:
+        raise RuntimeError(f'Failed to set pronunciation of {word}')
+
+# Skip words missing from the overrides and dictionaries instead of running the model
+def set_dictionary_only(enabled=True):
+    return babylon_lib.babylon_g2p_set_dictionary_only(int(enabled))
 
 # Free G2P resources
 def free_g2p():
     babylon_lib.babylon_g2p_free()
 
 # Initialize TTS
-def init_tts(model_path):
-    return babylon_lib.babylon_tts_init(model_path.encode('utf-8'))
+def init_tts(model_path, use_shared_weights=False):
+    return babylon_lib.babylon_tts_init_with_options(_encode(model_path), TTSOptions(use_shared_weights))
+
+def sample_rate():
+    return babylon_lib.babylon_tts_sample_rate()
 
 # Use TTS
 def tts(text, output_path):
-    babylon_lib.babylon_tts(text.encode('utf-8'), output_path.encode('utf-8'))
+    babylon_lib.babylon_tts(_encode(text), _encode(output_path))
+
+# Returns a read-only float32 NumPy array viewing the library's PCM buffer, and its sample rate
+def tts_pcm(text):
+    audio = babylon_lib.babylon_tts_pcm(_encode(text))
+    if not audio:
+        raise RuntimeError('TTS failed')
+
+    contents = audio.contents
+    address = ctypes.cast(contents.samples, ctypes.c_void_p).value
+    return _as_array(address, contents.sample_count, '<f4', lambda: babylon_lib.babylon_audio_free(audio)), contents.sample_rate
+
+# Synthesizes each text on its own thread, the GIL is released while the library works
+def tts_batch(texts, workers=None):
+    from concurrent.futures import ThreadPoolExecutor
+
+    with ThreadPoolExecutor(max_workers=workers) as executor:
+        return list(executor.map(tts_pcm, texts))
+
+# Yields float32 NumPy chunks while synthesis is still running. Chunks only live for the
+# duration of the library callback, so each one is copied once into its own array.
+def tts_stream(text, max_pending=16):
+    import numpy as np
+
+    chunks = queue.Queue(max_pending)
+    stopped = threading.Event()
+    done = object()
+
+    @AudioCallback
+    def on_audio(samples, count, user_data):
+        if stopped.is_set():
+            return 1
+        chunks.put(np.ctypeslib.as_array(samples, shape=(count,)).copy())
+        return 0
+
+    def run():
+        try:
+            status = babylon_lib.babylon_tts_stream(_encode(text), on_audio, None)
+            chunks.put(done if status == 0 or stopped.is_set() else RuntimeError('TTS failed'))
+        except BaseException as e:
+            chunks.put(e)
+
+    worker = threading.Thread(target=run, daemon=True)
+    worker.start()
+
+    try:
+        while True:
+            chunk = chunks.get()
+            if chunk is done:
+                break
+            if isinstance(chunk, BaseException):
+                raise chunk
+            yield chunk
+    finally:
+        # Unblock the callback if the consumer stopped early, it then asks the library to stop
+        stopped.set()
+        while worker.is_alive():
+            try:
+                chunks.get(timeout=0.1)
+            except queue.Empty:
+                pass
+        worker.join()
 
 # Free TTS resources
 def free_tts():
@@ -78,22 +361,25 @@ if __name__ == '__main__':
     g2p_model_path = os.path.join(current_dir, "models", "deep_phonemizer.onnx")
     tts_model_path = os.path.join(current_dir, "models", "curie.onnx")
     language = 'en_us'
-    use_punctuation = 1
+    use_punctuation = True
     sequence = 'Hello world, This is a python test of babylon'
-    
-    if init_g2p(g2p_model_path, language, use_punctuation) == 0:
+
+    if init_g2p(g2p_model_path, language, use_punctuation=use_punctuation) == 0:
         print('G2P initialized successfully')
         phonemes = g2p(sequence)
         print(f'Phonemes: {phonemes}')
-        
+
         tokens = g2p_tokens(sequence)
-        print(f'Tokens: {tokens}')
+        print(f'Tokens: {tokens.tolist()}')
     else:
         print('Failed to initialize G2P')
 
     if init_tts(tts_model_path) == 0:
         print('TTS initialized successfully')
         tts(sequence, './output.wav')
+
+        audio, rate = tts_pcm(sequence)
+        print(f'PCM: {len(audio)} samples at {rate} Hz')
     else:
         print('Failed to initialize TTS')
 
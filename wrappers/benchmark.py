@@ -0,0 +1,108 @@
+"""
+Measures babylon.cpp throughput through the Python wrapper.
+
+G2P is timed per call and batched, TTS as the real time factor of tts_pcm. Both are run
+from 1 up to --threads Python threads to show the calls scale while the GIL is released.
+
+python benchmark.py --g2p models/deep_phonemizer.onnx --tts models/curie.onnx --threads 4
+"""
+
+import argparse
+import os
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+import babylon
+
+SENTENCES = [
+    'The quick brown fox jumps over the lazy dog.',
+    'Dr. Smith paid 1250 dollars for 3 tickets on Friday.',
+    'She sells sea shells by the sea shore, and the shells she sells are surely sea shells.',
+    'How much wood would a woodchuck chuck if a woodchuck could chuck wood?',
+    'In 1969 two astronauts walked on the moon while millions watched.',
+]
+
+def thread_counts(limit):
+    counts = [1]
+    while counts[-1] * 2 <= limit:
+        counts.append(counts[-1] * 2)
+    if counts[-1] != limit:
+        counts.append(limit)
+    return counts
+
+def timed(function, items, threads):
+    start = time.perf_counter()
+    with ThreadPoolExecutor(max_workers=threads) as executor:
+        results = list(executor.map(function, items))
+    return time.perf_counter() - start, results
+
+def benchmark_g2p(texts, max_threads):
+    print(f'\nG2P: {len(texts)} sentences')
+    print(f'{"mode":>12} {"threads":>8} {"sentences/s":>12} {"ms/sentence":>12}')
+
+    for threads in thread_counts(max_threads):
+        elapsed, _ = timed(babylon.g2p, texts, threads)
+        print(f'{"per call":>12} {threads:>8} {len(texts) / elapsed:>12.1f} {elapsed / len(texts) * 1000:>12.2f}')
+
+    batch = 32
+    start = time.perf_counter()
+    for i in range(0, len(texts), batch):
+        babylon.g2p_batch(texts[i:i + batch])
+    elapsed = time.perf_counter() - start
+    print(f'{"batch " + str(batch):>12} {1:>8} {len(texts) / elapsed:>12.1f} {elapsed / len(texts) * 1000:>12.2f}')
+
+    # Token arrays are views of the library's buffer, this only measures the call itself
+    elapsed, _ = timed(babylon.g2p_tokens, texts, 1)
+    print(f'{"tokens":>12} {1:>8} {len(texts) / elapsed:>12.1f} {elapsed / len(texts) * 1000:>12.2f}')
+
+def benchmark_tts(texts, max_threads):
+    print(f'\nTTS: {len(texts)} sentences')
+    print(f'{"mode":>12} {"threads":>8} {"RTF":>8} {"audio s/s":>10} {"first chunk ms":>15}')
+
+    for threads in thread_counts(max_threads):
+        elapsed, results = timed(babylon.tts_pcm, texts, threads)
+        audio_seconds = sum(len(audio) / rate for audio, rate in results)
+        print(f'{"pcm":>12} {threads:>8} {elapsed / audio_seconds:>8.3f} {audio_seconds / elapsed:>10.2f} {"":>15}')
+
+    # Streaming trades some throughput for time to first audio
+    first_chunk = []
+    audio_seconds = 0.0
+    start = time.perf_counter()
+    for text in texts:
+        text_start = time.perf_counter()
+        for i, chunk in enumerate(babylon.tts_stream(text)):
+            if i == 0:
+                first_chunk.append(time.perf_counter() - text_start)
+            audio_seconds += len(chunk) / babylon.sample_rate()
+    elapsed = time.perf_counter() - start
+    print(f'{"stream":>12} {1:>8} {elapsed / audio_seconds:>8.3f} {audio_seconds / elapsed:>10.2f} {sum(first_chunk) / len(first_chunk) * 1000:>15.1f}')
+
+if __name__ == '__main__':
+    current_dir = os.path.dirname(os.path.abspath(__file__))
+
+    parser = argparse.ArgumentParser(description='Benchmark babylon.cpp through the Python wrapper')
+    parser.add_argument('--g2p', default=os.path.join(current_dir, 'models', 'deep_phonemizer.onnx'), help='DeepPhonemizer model')
+    parser.add_argument('--tts', default=None, help='VITS model, TTS is skipped without one')
+    parser.add_argument('--language', default='en_us')
+    parser.add_argument('--repeat', type=int, default=20, help='Times the sentence set is repeated')
+    parser.add_argument('--threads', type=int, default=os.cpu_count())
+    args = parser.parse_args()
+
+    if babylon.init_g2p(args.g2p, args.language) != 0:
+        raise SystemExit('Failed to initialize G2P')
+
+    texts = SENTENCES * args.repeat
+
+    # Warm up dictionaries and the ORT session before timing
+    babylon.g2p_batch(SENTENCES)
+    benchmark_g2p(texts, args.threads)
+
+    if args.tts is not None:
+        if babylon.init_tts(args.tts) != 0:
+            raise SystemExit('Failed to initialize TTS')
+
+        babylon.tts_pcm(SENTENCES[0])
+        benchmark_tts(SENTENCES * max(1, args.repeat // 10), args.threads)
+        babylon.free_tts()
+
+    babylon.free_g2p()